@@ -0,0 +1,83 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "uthread.h"
+
+#define NUM_THREAD 4
+#define NUM_INCR   20000
+
+struct umutex mutex;
+int gcnt;
+
+void
+fail(char *msg)
+{
+  printf(1, "affinitytest: %s\n", msg);
+  exit();
+}
+
+void*
+pinnedmain(void *arg)
+{
+  int i;
+
+  // Pin each thread to its own CPU (wrapping if there are fewer).
+  if(sched_setaffinity(0, 1 << ((int)arg % 8)) < 0 &&
+     sched_setaffinity(0, 1) < 0)
+    thread_exit((void*)-1);
+  for(i = 0; i < NUM_INCR; i++){
+    umutex_lock(&mutex);
+    gcnt++;
+    umutex_unlock(&mutex);
+  }
+  thread_exit(0);
+}
+
+void
+run(void)
+{
+  thread_t threads[NUM_THREAD];
+  void *ret;
+  int i;
+
+  gcnt = 0;
+  for(i = 0; i < NUM_THREAD; i++)
+    if(thread_create(&threads[i], pinnedmain, (void*)i) != 0)
+      fail("thread_create failed");
+  for(i = 0; i < NUM_THREAD; i++)
+    if(thread_join(threads[i], &ret) != 0 || ret != 0)
+      fail("thread failed");
+  if(gcnt != NUM_THREAD * NUM_INCR)
+    fail("lost updates");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int start;
+
+  printf(1, "affinitytest starting\n");
+  if(sched_setaffinity(0, 0) != -1)
+    fail("empty mask accepted");
+  if(sched_setaffinity(-1, 1) != -1)
+    fail("bad pid accepted");
+  if(sched_setaffinity(0, 1) != 0)
+    fail("pinning to CPU 0 failed");
+  if(sched_setaffinity(getpid(), ~0) != 0)
+    fail("unpinning failed");
+
+  umutex_init(&mutex);
+  start = uptime();
+  run();
+  printf(1, "pinned threads: %d ticks\n", uptime() - start);
+
+  if(sched_gang(1) != 0)
+    fail("sched_gang failed");
+  start = uptime();
+  run();
+  printf(1, "pinned threads, gang mode: %d ticks\n", uptime() - start);
+  sched_gang(0);
+
+  printf(1, "affinitytest ok\n");
+  exit();
+}
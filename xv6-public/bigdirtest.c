@@ -0,0 +1,97 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+#define NFILE_DEFAULT 10000
+
+char *dirpath = "bigdirtest.d";
+
+// Name of the i'th file: "f" followed by the decimal i.
+void
+mkname(char *name, int i)
+{
+  char tmp[DIRSIZ];
+  int n;
+
+  n = 0;
+  do {
+    tmp[n++] = '0' + i % 10;
+    i /= 10;
+  } while(i > 0);
+  name[0] = 'f';
+  for(i = 0; i < n; i++)
+    name[1 + i] = tmp[n - 1 - i];
+  name[1 + n] = 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nfile, i, fd, start;
+  char name[DIRSIZ];
+
+  nfile = (argc > 1) ? atoi(argv[1]) : NFILE_DEFAULT;
+
+  printf(1, "bigdirtest starting (%d files)\n", nfile);
+  if(mkdir(dirpath) < 0 || chdir(dirpath) < 0){
+    printf(1, "mkdir %s failed\n", dirpath);
+    exit();
+  }
+
+  printf(1, "1. create test\n");
+  start = uptime();
+  for(i = 0; i < nfile; i++){
+    if(i % 1000 == 0)
+      printf(1, "%d files created\n", i);
+    mkname(name, i);
+    if((fd = open(name, O_CREATE | O_RDWR)) < 0){
+      printf(1, "create %s failed\n", name);
+      exit();
+    }
+    close(fd);
+  }
+  printf(1, "created %d files in %d ticks\n", nfile, uptime() - start);
+
+  printf(1, "2. lookup test\n");
+  start = uptime();
+  for(i = 0; i < nfile; i++){
+    mkname(name, i);
+    if((fd = open(name, O_RDONLY)) < 0){
+      printf(1, "open %s failed\n", name);
+      exit();
+    }
+    close(fd);
+  }
+  printf(1, "looked up %d files in %d ticks\n", nfile, uptime() - start);
+
+  printf(1, "3. missing lookup test\n");
+  start = uptime();
+  for(i = nfile; i < 2 * nfile; i++){
+    mkname(name, i);
+    if((fd = open(name, O_RDONLY)) >= 0){
+      printf(1, "open %s succeeded\n", name);
+      exit();
+    }
+  }
+  printf(1, "missed %d files in %d ticks\n", nfile, uptime() - start);
+
+  printf(1, "4. unlink test\n");
+  start = uptime();
+  for(i = 0; i < nfile; i++){
+    mkname(name, i);
+    if(unlink(name) < 0){
+      printf(1, "unlink %s failed\n", name);
+      exit();
+    }
+  }
+  printf(1, "unlinked %d files in %d ticks\n", nfile, uptime() - start);
+
+  if(chdir("..") < 0 || unlink(dirpath) < 0){
+    printf(1, "rm %s failed\n", dirpath);
+    exit();
+  }
+  printf(1, "bigdirtest ok\n");
+  exit();
+}
@@ -14,6 +14,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "x86.h"
+#include "poll.h"
 
 static void consputc(int);
 
@@ -184,6 +185,7 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+  struct waitq wq;  // poll() callers
 } input;
 
 #define C(x)  ((x)-'@')  // Control-x
@@ -221,6 +223,7 @@ consoleintr(int (*getc)(void))
         if(c == '\n' || c == C('D') || input.e == input.r+INPUT_BUF){
           input.w = input.e;
           wakeup(&input.r);
+          waitqwake(&input.wq, POLLIN);
         }
       }
       break;
@@ -285,6 +288,22 @@ consolewrite(struct inode *ip, char *buf, int n)
   return n;
 }
 
+// The console can always be written; it can be read once
+// a line has been typed.
+int
+consolepoll(struct inode *ip, struct pollent *pe)
+{
+  int mask;
+
+  acquire(&cons.lock);
+  pollregister(&input.wq, pe);
+  mask = POLLOUT;
+  if(input.r != input.w)
+    mask |= POLLIN;
+  release(&cons.lock);
+  return mask;
+}
+
 void
 consoleinit(void)
 {
@@ -292,6 +311,7 @@ consoleinit(void)
 
   devsw[CONSOLE].write = consolewrite;
   devsw[CONSOLE].read = consoleread;
+  devsw[CONSOLE].poll = consolepoll;
   cons.locking = 1;
 
   ioapicenable(IRQ_KBD, 0);
@@ -0,0 +1,69 @@
+// Time yield() ping-pong between two threads of one process,
+// which share a page table, and between two processes, which
+// don't, and count the page table reloads each costs. Both
+// sides are pinned to CPU 0 so that every yield is a context
+// switch.
+//
+// cswbench [nswitch]
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int nswitch = 20000;
+
+void
+fail(char *msg)
+{
+  printf(1, "cswbench: %s\n", msg);
+  exit();
+}
+
+void*
+yieldmain(void *arg)
+{
+  int i;
+
+  for(i = 0; i < nswitch; i++)
+    yield();
+  thread_exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  thread_t tid;
+  void *ret;
+  int i, pid, t, r;
+
+  if(argc > 1)
+    nswitch = atoi(argv[1]);
+  if(nswitch < 1)
+    fail("bad switch count");
+  if(sched_setaffinity(0, 1) != 0)
+    fail("sched_setaffinity failed");
+  printf(1, "cswbench: %d yields per side\n", nswitch);
+
+  t = uptime();
+  r = cr3reloads();
+  if(thread_create(&tid, yieldmain, 0) != 0)
+    fail("thread_create failed");
+  for(i = 0; i < nswitch; i++)
+    yield();
+  if(thread_join(tid, &ret) != 0)
+    fail("thread_join failed");
+  printf(1, "threads:   %d ticks, %d CR3 reloads\n", uptime() - t, cr3reloads() - r);
+
+  t = uptime();
+  r = cr3reloads();
+  if((pid = fork()) < 0)
+    fail("fork failed");
+  for(i = 0; i < nswitch; i++)
+    yield();
+  if(pid == 0)
+    exit();
+  wait();
+  printf(1, "processes: %d ticks, %d CR3 reloads\n", uptime() - t, cr3reloads() - r);
+
+  printf(1, "cswbench ok\n");
+  exit();
+}
@@ -1,18 +1,29 @@
 struct buf;
 struct context;
+struct epoll_event;
+struct epitem;
+struct eventpoll;
 struct file;
 struct inode;
+struct iovec;
+struct irange;
+struct lockprof;
+struct lockstat;
 struct pipe;
+struct pollfd;
+struct pollent;
 struct proc;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct waitq;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bnew(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 
@@ -31,13 +42,20 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filepoll(struct file*, struct pollent*);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
 int             pwrite(struct file*, char*, int n, int off);
 int             pread(struct file*, char*, int n, int off);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
+int             preadv(struct file*, struct iovec*, int, int);
+int             pwritev(struct file*, struct iovec*, int, int);
+int             filesend(struct file*, struct file*, int n);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
+void            dcinvalidate(struct inode*, char*);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
@@ -46,6 +64,12 @@ void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
+void            ilockshared(struct inode*);
+void            iunlockshared(struct inode*);
+void            irangelock(struct inode*, struct irange*, uint, uint, int);
+void            irangeunlock(struct inode*, struct irange*);
+int             iallocated(struct inode*, uint, uint);
+void            writeirange(struct inode*, char*, uint, uint);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
@@ -100,14 +124,31 @@ void            picinit(void);
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, char*, int);
-int             pipewrite(struct pipe*, char*, int);
+int             piperead(struct pipe*, char*, int, int);
+int             pipewrite(struct pipe*, char*, int, int);
+int             pipegift(struct pipe*, char*, int, int);
+int             pipegetsize(struct pipe*);
+int             pipesetsize(struct pipe*, int);
+int             pipepoll(struct pipe*, int, struct pollent*);
+
+// poll.c
+void            pollinit(void);
+void            pollregister(struct waitq*, struct pollent*);
+void            waitqwake(struct waitq*, uint);
+int             pollfds(struct pollfd*, int, int);
+struct eventpoll* epollalloc(void);
+int             epollctl(struct eventpoll*, int, int, struct file*, struct epoll_event*);
+int             epollwait(struct eventpoll*, struct epoll_event*, int, int);
+int             epollpoll(struct eventpoll*, struct pollent*);
+void            epollclose(struct eventpoll*);
+void            epolldetach(struct file*);
 
 //PAGEBREAK: 16
 // proc.c
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
+void            freepgdir(pde_t*);
 int             growproc(int);
 int             kill(int);
 struct cpu*     mycpu(void);
@@ -127,14 +168,30 @@ int             set_cpu_share(int);
 int             thread_create(thread_t*, void*(*start_routine)(void*), void*);
 void            thread_exit(void*);
 int             thread_join(thread_t, void**);
+int             futexwait(uint, int);
+int             futexwake(uint, int);
+int             setaffinity(int, uint);
+int             setgang(int);
+
+// rcu.c
+void            rcuinit(void);
+void            rcu_read_lock(void);
+void            rcu_read_unlock(void);
+void            rcu_qs(void);
+uint            rcu_gpstart(void);
+int             rcu_gpdone(uint);
+void            synchronize_rcu(void);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
 
 // spinlock.c
 void            acquire(struct spinlock*);
+void            freelock(struct spinlock*);
 void            getcallerpcs(void*, uint*);
+int             getlockstats(struct lockstat*, int);
 int             holding(struct spinlock*);
+int             lockprofctl(int, struct lockprof*, int);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            pushcli(void);
@@ -144,7 +201,11 @@ void            popcli(void);
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
+void            releasesleepshared(struct sleeplock*);
+int             holdingsleepshared(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+void            freesleeplock(struct sleeplock*);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -189,9 +250,14 @@ void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
+void            switchuvmsched(struct proc*);
+int             uvmreloads(void);
+void            uvmchanged(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             inittls(pde_t*, uint);
+int             swapupage(pde_t*, char*, char**);
 
 // prac_syscall.c
 int				printk_str(char*);
@@ -0,0 +1,143 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "poll.h"
+
+#define NPIPE 6
+
+int fds[NPIPE][2];
+struct epoll_event evs[16];
+
+void
+fail(char *msg)
+{
+  printf(1, "epolltest: %s\n", msg);
+  exit();
+}
+
+// Return a bitmask of the data fields of the events reported.
+int
+waitmask(int epfd, int timeout)
+{
+  int n, i, mask;
+
+  if((n = epoll_wait(epfd, evs, 16, timeout)) < 0)
+    fail("epoll_wait failed");
+  mask = 0;
+  for(i = 0; i < n; i++){
+    if(!(evs[i].events & EPOLLIN))
+      fail("event without EPOLLIN");
+    mask |= 1 << evs[i].data;
+  }
+  return mask;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int epfd, i, pid, q[2], fd;
+  struct epoll_event ev;
+  struct pollfd pfd;
+  char c;
+
+  printf(1, "epolltest starting\n");
+  if((epfd = epoll_create()) < 0)
+    fail("epoll_create failed");
+  // Pipes 0-2 are level-triggered, 3-5 edge-triggered.
+  for(i = 0; i < NPIPE; i++){
+    if(pipe(fds[i]) < 0)
+      fail("pipe failed");
+    ev.events = EPOLLIN | (i >= 3 ? EPOLLET : 0);
+    ev.data = i;
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i][0], &ev) < 0)
+      fail("EPOLL_CTL_ADD failed");
+  }
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0][0], &ev) == 0)
+    fail("added the same fd twice");
+
+  printf(1, "1. level and edge test\n");
+  if(waitmask(epfd, 0) != 0)
+    fail("empty pipes reported ready");
+  for(i = 0; i < NPIPE; i++)
+    write(fds[i][1], "x", 1);
+  if(waitmask(epfd, 0) != 077)
+    fail("not all pipes reported");
+  if(waitmask(epfd, 0) != 07)
+    fail("level-triggered pipes not reported again");
+  if(epoll_ctl(epfd, EPOLL_CTL_DEL, fds[0][0], 0) < 0)
+    fail("EPOLL_CTL_DEL failed");
+  if(waitmask(epfd, 0) != 06)
+    fail("deleted pipe still reported");
+  for(i = 0; i < NPIPE; i++)
+    read(fds[i][0], &c, 1);
+  if(waitmask(epfd, 0) != 0)
+    fail("drained pipes reported ready");
+
+  // A read makes room, which doesn't concern an EPOLLIN watcher.
+  write(fds[3][1], "ab", 2);
+  if(waitmask(epfd, 0) != 1 << 3)
+    fail("edge-triggered pipe not reported");
+  read(fds[3][0], &c, 1);
+  if(waitmask(epfd, 0) != 0)
+    fail("partial read re-armed edge-triggered pipe");
+  read(fds[3][0], &c, 1);
+
+  printf(1, "2. wait test\n");
+  if((pid = fork()) < 0)
+    fail("fork failed");
+  if(pid == 0){
+    sleep(5);
+    write(fds[4][1], "y", 1);
+    exit();
+  }
+  if(waitmask(epfd, -1) != 1 << 4)
+    fail("wrong pipe woke epoll_wait");
+  wait();
+  read(fds[4][0], &c, 1);
+  if(c != 'y')
+    fail("bad data");
+
+  printf(1, "3. poll on epoll fd test\n");
+  if(waitmask(epfd, 0) != 0)
+    fail("drained pipe reported ready");
+  pfd.fd = epfd;
+  pfd.events = POLLIN;
+  if(poll(&pfd, 1, 0) != 0)
+    fail("idle epoll fd readable");
+  write(fds[1][1], "z", 1);
+  if(poll(&pfd, 1, 0) != 1 || !(pfd.revents & POLLIN))
+    fail("epoll fd not readable");
+
+  printf(1, "4. close test\n");
+  // Watching a pipe's write end must not keep it open.
+  if(pipe(q) < 0)
+    fail("pipe failed");
+  ev.events = EPOLLOUT;
+  ev.data = 9;
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, q[1], &ev) < 0)
+    fail("EPOLL_CTL_ADD failed");
+  fd = q[1];
+  close(q[1]);
+  if(read(q[0], &c, 1) != 0)
+    fail("closed write end still open");
+  close(q[0]);
+  // The closed fd's item went with it, so its number can be
+  // added again for a new file.
+  if(pipe(q) < 0)
+    fail("pipe failed");
+  if(q[0] != fd && q[1] != fd)
+    fail("fd not reused");
+  ev.events = EPOLLIN;
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    fail("reused fd can't be added");
+  close(q[0]);
+  close(q[1]);
+
+  close(epfd);
+  for(i = 0; i < NPIPE; i++){
+    close(fds[i][0]);
+    close(fds[i][1]);
+  }
+  printf(1, "epolltest ok\n");
+  exit();
+}
@@ -18,7 +18,7 @@ exec(char *path, char **argv)
 {
   char *s, *last;
   int i, off;
-  uint argc, sz, sp, ustack[3+MAXARG+1];
+  uint argc, sz, sp, tlsbase, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
@@ -75,6 +75,12 @@ exec(char *path, char **argv)
   clearpteu(pgdir, (char*)(sz - 2*PGSIZE));
   sp = sz;
 
+  // The main thread's TLS block sits at the top of its stack.
+  sp -= TLSSIZE;
+  tlsbase = sp;
+  if(inittls(pgdir, tlsbase) < 0)
+    goto bad;
+
   // Push argument strings, prepare rest of stack in ustack.
   for(argc = 0; argv[argc]; argc++) {
     if(argc >= MAXARG)
@@ -106,11 +112,18 @@ exec(char *path, char **argv)
   curproc->sz = sz;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
+  curproc->tlsbase = tlsbase;
+  curproc->ioring = 0;
+  curproc->nstackfree = 0;  // thread stack slots went with the old image
+  curproc->sum_of_threads = 0;
   switchuvm(curproc);
 
   // Process case.
   if(curproc->tid == 0){
-    freevm(oldpgdir);
+    // Another CPU's scheduler may still have oldpgdir loaded.
+    acquire(&ptable.lock);
+    freepgdir(oldpgdir);
+    release(&ptable.lock);
   }
   // Thread case.
   else{
@@ -2,3 +2,14 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+#define O_NONBLOCK 0x400  // read/write return EWOULDBLOCK rather than sleep
+
+// fcntl() commands
+#define F_GETPIPE_SZ  1  // capacity of a pipe in bytes
+#define F_SETPIPE_SZ  2  // set capacity of a pipe; returns new capacity
+#define F_GETFL       3  // open flags
+#define F_SETFL       4  // set O_NONBLOCK
+
+// Returned by read/write on an O_NONBLOCK file that would
+// have had to sleep.
+#define EWOULDBLOCK   (-2)
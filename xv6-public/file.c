@@ -5,10 +5,15 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
+#include "stat.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
+#include "fcntl.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -32,6 +37,7 @@ filealloc(void)
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
+      f->flags = 0;
       release(&ftable.lock);
       return f;
     }
@@ -61,6 +67,13 @@ fileclose(struct file *f)
   acquire(&ftable.lock);
   if(f->ref < 1)
     panic("fileclose");
+  if(f->ref == 1 && f->epitems){
+    // Last reference: take f out of every epoll interest set
+    // first, as they don't hold references of their own.
+    release(&ftable.lock);
+    epolldetach(f);
+    acquire(&ftable.lock);
+  }
   if(--f->ref > 0){
     release(&ftable.lock);
     return;
@@ -76,7 +89,8 @@ fileclose(struct file *f)
     begin_op();
     iput(ff.ip);
     end_op();
-  }
+  } else if(ff.type == FD_EPOLL)
+    epollclose(ff.ep);
 }
 
 // Get metadata about file f.
@@ -84,14 +98,40 @@ int
 filestat(struct file *f, struct stat *st)
 {
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, st);
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     return 0;
   }
   return -1;
 }
 
+// Report which poll() events hold for file f, and queue ps
+// to be woken when that may change. Regular files and
+// directories are always ready.
+int
+filepoll(struct file *f, struct pollent *pe)
+{
+  struct inode *ip;
+  short type, major;
+
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable, pe);
+  if(f->type == FD_EPOLL)
+    return epollpoll(f->ep, pe);
+  if(f->type == FD_INODE){
+    ip = f->ip;
+    ilockshared(ip);
+    type = ip->type;
+    major = ip->major;
+    iunlockshared(ip);
+    if(type == T_DEV && major >= 0 && major < NDEV && devsw[major].poll)
+      return devsw[major].poll(ip, pe);
+    return (f->readable ? POLLIN : 0) | (f->writable ? POLLOUT : 0);
+  }
+  panic("filepoll");
+}
+
 // Read from file f.
 int
 fileread(struct file *f, char *addr, int n)
@@ -101,8 +141,11 @@ fileread(struct file *f, char *addr, int n)
   if(f->readable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+    return piperead(f->pipe, addr, n, f->flags & O_NONBLOCK);
   if(f->type == FD_INODE){
+    // Only devices (the console) can be unready.
+    if((f->flags & O_NONBLOCK) && !(filepoll(f, 0) & POLLIN))
+      return EWOULDBLOCK;
     ilock(f->ip);
     if((r = readi(f->ip, addr, f->off, n)) > 0)
       f->off += r;
@@ -113,9 +156,11 @@ fileread(struct file *f, char *addr, int n)
 }
 
 //PAGEBREAK!
-// Write to file f.
-int
-filewrite(struct file *f, char *addr, int n)
+// Write to file f, sleeping for room only if nonblock is 0.
+// Returns the number of bytes written, short only if an error
+// stopped it part way, or -1 if none were.
+static int
+filewrite1(struct file *f, char *addr, int n, int nonblock)
 {
   int r;
 
@@ -123,8 +168,10 @@ filewrite(struct file *f, char *addr, int n)
     return -1;
   }
   if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+    return pipewrite(f->pipe, addr, n, nonblock);
   if(f->type == FD_INODE){
+    if(nonblock && !(filepoll(f, 0) & POLLOUT))
+      return EWOULDBLOCK;
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
     // i-node, indirect block, allocation blocks,
@@ -151,67 +198,282 @@ filewrite(struct file *f, char *addr, int n)
         panic("short filewrite");
       i += r;
     }
-    return i == n ? n : -1;
+    return i > 0 ? i : -1;
   }
   panic("filewrite");
 }
 
+// Write to file f.
 int
-pwrite(struct file *f, char *addr, int n, int off){
-  int r;
+filewrite(struct file *f, char *addr, int n)
+{
+  return filewrite1(f, addr, n, f->flags & O_NONBLOCK);
+}
 
-  if(f->writable == 0){
-    return -1;
-  }
-  //if(f->type == FD_PIPE)
-  //  return pipewrite(f->pipe, addr, n);
-  if(f->type == FD_INODE){
-    while(f->ip->size < off + n){
-      char tmp[1000] = {' ', };
-      filewrite(f, tmp, sizeof(tmp));
+// Write the segments of iov to f's inode at *off, advancing
+// *off. Consecutive segments share a log transaction as long
+// as they fit in one, so a header and a small payload cost a
+// single commit.
+// If shared is set, a transaction that only overwrites blocks
+// the file already has runs with the inode locked shared plus
+// a byte-range lock, so writers to disjoint parts of a file
+// don't wait for each other. Anything that may allocate or
+// grow the file takes the inode lock exclusively.
+static int
+writeiv(struct file *f, struct iovec *iov, int iovcnt, uint *off, int shared)
+{
+  // Same per-transaction limit as filewrite().
+  int max = ((MAXOPBLOCKS-1-1-1-1-2) / 2) * 512;
+  struct inode *ip = f->ip;
+  struct irange rl;
+  int i, j, s, done, room, n1, r, segoff, span, ranged;
+
+  i = 0;
+  segoff = 0;
+  done = 0;
+  while(i < iovcnt){
+    begin_op();
+    ranged = 0;
+    if(shared){
+      for(span = 0, j = i, s = segoff; j < iovcnt && span < max; j++, s = 0)
+        span += iov[j].iov_len - s;
+      if(span > max)
+        span = max;
+      ilockshared(ip);
+      if(iallocated(ip, *off, span)){
+        irangelock(ip, &rl, *off, *off + span, 0);
+        ranged = 1;
+      } else
+        iunlockshared(ip);
     }
-    
-    int max = ((MAXOPBLOCKS-1-1-1-1-2) / 2) * 512;
-    int i = 0;
-    int local_off = off;
-    
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
+    if(!ranged)
+      ilock(ip);
+    for(room = max; room > 0 && i < iovcnt; room -= n1){
+      n1 = iov[i].iov_len - segoff;
+      if(n1 > room)
+        n1 = room;
+      if(ranged && n1 > 0)
+        writeirange(ip, (char*)iov[i].iov_base + segoff, *off, n1);
+      else if(n1 > 0 &&
+         (r = writei(ip, (char*)iov[i].iov_base + segoff, *off, n1)) != n1){
+        iunlock(ip);
+        end_op();
+        if(r >= 0)
+          panic("short writeiv");
+        return -1;
+      }
+      *off += n1;
+      done += n1;
+      segoff += n1;
+      if(segoff == iov[i].iov_len){
+        i++;
+        segoff = 0;
+      }
+    }
+    if(ranged){
+      irangeunlock(ip, &rl);
+      iunlockshared(ip);
+    } else
+      iunlock(ip);
+    end_op();
+  }
+  return done;
+}
 
-      begin_op();
-      ilock(f->ip);
-      if((r = writei(f->ip, addr + i, local_off, n1)) > 0)
-        local_off += r;
-      iunlock(f->ip);
-      end_op();
+// Read into the segments of iov from f's inode at *off,
+// advancing *off. Stops at the end of the file.
+// If shared is set the inode is only locked shared, so
+// concurrent readers don't wait for each other; callers
+// updating f->off must not set it. The bytes to be read are
+// then locked as a shared range, which keeps out writeiv()'s
+// ranged writers.
+static int
+readiv(struct file *f, struct iovec *iov, int iovcnt, uint *off, int shared)
+{
+  struct inode *ip = f->ip;
+  struct irange rl;
+  uint end;
+  int i, r, done;
 
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short pwrite");
-      i += r;
+  if(shared){
+    ilockshared(ip);
+    if(ip->type == T_DEV){
+      // Device drivers relock the inode exclusively.
+      iunlockshared(ip);
+      shared = 0;
+    } else {
+      end = *off;
+      for(i = 0; i < iovcnt; i++)
+        if((end += iov[i].iov_len) < *off){
+          end = ~0;  // wrapped; readi() will stop at the size
+          break;
+        }
+      irangelock(ip, &rl, *off, end, 1);
     }
-    return i == n ? n : -1;
   }
-  panic("pwrite");
+  if(!shared)
+    ilock(ip);
+  done = 0;
+  for(i = 0; i < iovcnt; i++){
+    if((r = readi(ip, iov[i].iov_base, *off, iov[i].iov_len)) < 0){
+      done = -1;
+      break;
+    }
+    *off += r;
+    done += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  if(shared){
+    irangeunlock(ip, &rl);
+    iunlockshared(ip);
+  } else
+    iunlock(ip);
+  return done;
+}
+
+int
+pwrite(struct file *f, char *addr, int n, int off){
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return pwritev(f, &iov, 1, off);
+}
+
+// Write the segments of iov to file f at offset off.
+int
+pwritev(struct file *f, struct iovec *iov, int iovcnt, int off)
+{
+  uint o;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_INODE){
+    // Writing past the end leaves a hole; see writei().
+    o = off;
+    return writeiv(f, iov, iovcnt, &o, 1);
+  }
+  return -1;  // pipes have no offsets
 }
 
 // Read from file f at offset off.
 int
 pread(struct file *f, char *addr, int n, int off){
-  int r;
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return preadv(f, &iov, 1, off);
+}
+
+// Read into the segments of iov from file f at offset off.
+int
+preadv(struct file *f, struct iovec *iov, int iovcnt, int off)
+{
+  uint o;
 
   if(f->readable == 0)
     return -1;
-  //if(f->type == FD_PIPE)
-  //  return piperead(f->pipe, addr, n);
   if(f->type == FD_INODE){
-    ilock(f->ip);
-    r = readi(f->ip, addr, off, n);
-    iunlock(f->ip);
-    return r;
+    o = off;
+    return readiv(f, iov, iovcnt, &o, 1);
+  }
+  return -1;
+}
+
+// Read into the segments of iov from file f, stopping early
+// if a segment can't be filled.
+int
+filereadv(struct file *f, struct iovec *iov, int iovcnt)
+{
+  int i, r, done;
+
+  if(f->readable == 0)
+    return -1;
+  if(f->type == FD_INODE){
+    if((f->flags & O_NONBLOCK) && !(filepoll(f, 0) & POLLIN))
+      return EWOULDBLOCK;
+    return readiv(f, iov, iovcnt, &f->off, 0);
+  }
+  done = 0;
+  for(i = 0; i < iovcnt; i++){
+    if((r = fileread(f, iov[i].iov_base, iov[i].iov_len)) < 0)
+      return done > 0 ? done : r;
+    done += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  return done;
+}
+
+// Write the segments of iov to file f.
+int
+filewritev(struct file *f, struct iovec *iov, int iovcnt)
+{
+  int i, r, done;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_INODE){
+    if((f->flags & O_NONBLOCK) && !(filepoll(f, 0) & POLLOUT))
+      return EWOULDBLOCK;
+    return writeiv(f, iov, iovcnt, &f->off, 0);
+  }
+  done = 0;
+  for(i = 0; i < iovcnt; i++){
+    if((r = filewrite(f, iov[i].iov_base, iov[i].iov_len)) < 0)
+      return done > 0 ? done : r;
+    done += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  return done;
+}
+
+// Move up to n bytes from file in to file out without
+// copying them through user space. Data goes through one
+// kernel page: fileread() fills it and filewrite() drains it,
+// so any readable/writable pair works (inode to pipe, pipe to
+// inode, inode to inode). Stops early at end of input, or when
+// a non-blocking input has nothing more; always waits for room
+// in out. If out takes only part of a chunk, an inode input is
+// wound back to just past the bytes sent.
+// Returns the number of bytes moved, or -1 (or EWOULDBLOCK)
+// if none could be.
+int
+filesend(struct file *out, struct file *in, int n)
+{
+  char *page;
+  int done, n1, r, w;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if((page = kalloc()) == 0)
+    return -1;
+  done = 0;
+  while(done < n){
+    n1 = n - done;
+    if(n1 > PGSIZE)
+      n1 = PGSIZE;
+    if((r = fileread(in, page, n1)) <= 0){
+      if(r < 0 && done == 0)
+        done = r;
+      break;
+    }
+    if((w = filewrite1(out, page, r, 0)) != r){
+      if(w < 0)
+        w = 0;
+      // Leave the input just past what was sent.
+      if(in->type == FD_INODE)
+        in->off -= r - w;
+      done += w;
+      if(done == 0)
+        done = -1;
+      break;
+    }
+    done += r;
   }
-  panic("pread");
+  kfree(page);
+  return done;
 }
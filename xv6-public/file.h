@@ -1,11 +1,14 @@
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_EPOLL } type;
   int ref; // reference count
   char readable;
   char writable;
+  int flags;     // O_NONBLOCK
   struct pipe *pipe;
   struct inode *ip;
+  struct eventpoll *ep;
   uint off;
+  struct epitem *epitems; // epoll items watching this file
 };
 
 
@@ -14,6 +17,10 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext; // icache hash chain
+  struct inode *prev;  // icache LRU list, while ref is 0
+  struct inode *next;
+  struct irange *ranges; // byte ranges held, protected by irangelk
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -23,6 +30,32 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+3];
+
+  uint lastblk;       // block last allocated by bmap() (not on disk)
+};
+
+// A locked byte range of an inode; see irangelock().
+struct irange {
+  uint start;         // first byte
+  uint end;           // one past the last byte
+  int shared;         // held by a reader?
+  struct irange *next;
+};
+
+// Kernel wait queues that poll() and epoll sleep on. Objects
+// that can be polled (pipes, the console) own a waitq and call
+// waitqwake() whenever they may have become readable or
+// writable, passing the poll events that may have changed.
+// All lists are protected by polllock in poll.c.
+struct waitq {
+  struct pollent *head;
+};
+
+struct pollent {
+  struct waitq *wq;        // queue this entry is on, or 0
+  struct pollent *next;
+  void (*wake)(struct pollent*, uint);  // called by waitqwake()
+  void *arg;               // for wake
 };
 
 // table mapping major device number to
@@ -30,6 +63,7 @@ struct inode {
 struct devsw {
   int (*read)(struct inode*, char*, int);
   int (*write)(struct inode*, char*, int);
+  int (*poll)(struct inode*, struct pollent*);  // optional
 };
 
 extern struct devsw devsw[];
@@ -20,9 +20,13 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "rcu.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void dcinit(void);
+static void dcinsert(struct inode*, char*, uint);
+static void dcpurge(struct inode*);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -39,12 +43,14 @@ readsb(int dev, struct superblock *sb)
 }
 
 // Zero a block.
+// The block was just allocated, so its old contents are
+// garbage: fill a buffer without reading it from disk.
 static void
 bzero(int dev, int bno)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
+  bp = bnew(dev, bno);
   memset(bp->data, 0, BSIZE);
   log_write(bp);
   brelse(bp);
@@ -52,29 +58,58 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Block number just past the most recent allocation.
+// Only a hint for where balloc() starts looking, so it
+// is read and written without a lock.
+static uint brotor;
+
+// Mark the first free block in [from, to) as in use.
+// Returns 0 if there is none.
 static uint
-balloc(uint dev)
+bscan(uint dev, uint from, uint to)
 {
-  int b, bi, m;
+  uint b, bi, m;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
+  for(b = from - from % BPB; b < to; b += BPB){
     bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+    for(bi = (b < from) ? from - b : 0; bi < BPB && b + bi < to; bi++){
+      if(bi % 8 == 0 && bp->data[bi/8] == 0xff){
+        bi += 7;  // whole byte in use
+        continue;
+      }
       m = 1 << (bi % 8);
       if((bp->data[bi/8] & m) == 0){  // Is block free?
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
         return b + bi;
       }
     }
     brelse(bp);
   }
-  panic("balloc: out of blocks");
+  return 0;
+}
+
+// Allocate a zeroed disk block.
+// Prefer the first free block at or after goal, so that blocks
+// written one after another end up contiguous on disk; with no
+// goal, continue from the last allocation instead of rescanning
+// the bitmap from block 0.
+static uint
+balloc(uint dev, uint goal)
+{
+  uint b;
+
+  if(goal == 0 || goal >= sb.size)
+    goal = brotor;
+  if(goal >= sb.size)
+    goal = 0;
+  if((b = bscan(dev, goal, sb.size)) == 0 && (b = bscan(dev, 0, goal)) == 0)
+    panic("balloc: out of blocks");
+  brotor = b + 1;
+  bzero(dev, b);
+  return b;
 }
 
 // Free a disk block.
@@ -121,7 +156,7 @@ bfree(int dev, uint b)
 //   the reference and link counts have fallen to zero.
 //
 // * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
+//   is unreferenced if ip->ref is zero. Otherwise ip->ref tracks
 //   the number of in-memory pointers to the entry (open
 //   files and current directories). iget() finds or
 //   creates a cache entry and increments its ref; iput()
@@ -130,8 +165,8 @@ bfree(int dev, uint b)
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
-//   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   the disk and sets ip->valid, while iget() clears
+//   ip->valid when it recycles an unreferenced entry.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -163,20 +198,92 @@ bfree(int dev, uint b)
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+//
+// Entries are found through a hash table on (dev, inum).
+// Unreferenced entries stay cached (and valid) on an LRU list
+// until iget() needs one; if none is free, or the cache is still
+// smaller than NINODEMAX, iget() grows the cache by a page of
+// entries instead. icache.lock protects the hash chains and the
+// LRU list as well.
+
+#define NIHASH 128
 
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
+  struct inode *hash[NIHASH];
+  int ninode;               // number of entries, static and kalloc'd
+
+  // Unreferenced entries, through prev/next.
+  // lru.next is the least recently used.
+  struct inode lru;
 } icache;
 
+static struct inode**
+ihash(uint dev, uint inum)
+{
+  return &icache.hash[(dev * 31 + inum) % NIHASH];
+}
+
+// Append a new, unreferenced entry to the cache.
+// Caller must hold icache.lock.
+static void
+iadd(struct inode *ip)
+{
+  initsleeplock(&ip->lock, "inode");
+  ip->ref = 0;
+  ip->inum = 0;
+  ip->valid = 0;
+  ip->hnext = 0;
+  ip->ranges = 0;
+  ip->next = icache.lru.next;
+  ip->prev = &icache.lru;
+  icache.lru.next->prev = ip;
+  icache.lru.next = ip;
+  icache.ninode++;
+}
+
+// Take an unreferenced entry off the LRU list.
+// Caller must hold icache.lock.
+static void
+ilruremove(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+  ip->next = ip->prev = 0;
+}
+
+// Add a page's worth of entries to the cache.
+// Returns 0 if there is no memory left.
+// Caller must hold icache.lock.
+static int
+igrow(void)
+{
+  struct inode *ip;
+  char *mem;
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  for(ip = (struct inode*)mem; ip+1 <= (struct inode*)(mem + PGSIZE); ip++)
+    iadd(ip);
+  return 1;
+}
+
+struct spinlock irangelk;  // protects every inode's ranges list
+
 void
 iinit(int dev)
 {
   int i = 0;
   
   initlock(&icache.lock, "icache");
+  initlock(&irangelk, "irange");
+  dcinit();
+  icache.lru.prev = &icache.lru;
+  icache.lru.next = &icache.lru;
   for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
+    iadd(&icache.inode[i]);
   }
 
   readsb(dev, &sb);
@@ -188,6 +295,9 @@ iinit(int dev)
 
 static struct inode* iget(uint dev, uint inum);
 
+// Inode number ialloc() last handed out; a hint like brotor.
+static uint irotor;
+
 //PAGEBREAK!
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -195,11 +305,14 @@ static struct inode* iget(uint dev, uint inum);
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  int i, inum;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
+  // Start after the last inode handed out rather than at 1,
+  // so that creating many files doesn't rescan the allocated ones.
+  for(i = 0; i < sb.ninodes - 1; i++){
+    inum = 1 + (irotor + i) % (sb.ninodes - 1);
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
@@ -207,6 +320,7 @@ ialloc(uint dev, short type)
       dip->type = type;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
+      irotor = inum;
       return iget(dev, inum);
     }
     brelse(bp);
@@ -242,31 +356,41 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = *ihash(dev, inum); ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        ilruremove(ip);
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Recycle the least recently used entry, growing the cache
+  // first if it is still small or every entry is in use.
+  if(icache.ninode < NINODEMAX || icache.lru.next == &icache.lru)
+    igrow();
+  ip = icache.lru.next;
+  if(ip == &icache.lru)
     panic("iget: no inodes");
+  ilruremove(ip);
+  if(ip->inum != 0){
+    for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  pp = ihash(dev, inum);
+  ip->hnext = *pp;
+  *pp = ip;
   release(&icache.lock);
 
   return ip;
@@ -306,6 +430,7 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->lastblk = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -322,6 +447,37 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock the given inode for reading only, allowing other
+// readers in at the same time. The holder may look at but
+// not change the inode or its content (readi(), stati(),
+// dirlookup()). Device reads need ilock(), since drivers
+// unlock and relock the inode.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  for(;;){
+    acquiresleepshared(&ip->lock);
+    if(ip->valid)
+      return;
+    // Let ilock() read it from disk, then try again.
+    releasesleepshared(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+  }
+}
+
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || !holdingsleepshared(&ip->lock) || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepshared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode cache entry can
 // be recycled.
@@ -339,6 +495,8 @@ iput(struct inode *ip)
     release(&icache.lock);
     if(r == 1){
       // inode has no links and no other references: truncate and free.
+      if(ip->type == T_DIR)
+        dcpurge(ip);
       itrunc(ip);
       ip->type = 0;
       iupdate(ip);
@@ -348,7 +506,13 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  if(--ip->ref == 0){
+    // Most recently used end of the LRU list.
+    ip->prev = icache.lru.prev;
+    ip->next = &icache.lru;
+    icache.lru.prev->next = ip;
+    icache.lru.prev = ip;
+  }
   release(&icache.lock);
 }
 
@@ -368,29 +532,42 @@ iunlockput(struct inode *ip)
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
 
+// Allocate a block for ip's content, directly after the
+// block most recently allocated for it when that one is free.
+static uint
+bmapalloc(struct inode *ip)
+{
+  ip->lastblk = balloc(ip->dev, ip->lastblk ? ip->lastblk + 1 : 0);
+  return ip->lastblk;
+}
+
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap allocates one if alloc is set
+// and otherwise returns 0, leaving a hole that reads as zeros.
 static uint
-bmap(struct inode *ip, uint bn)
+bmap(struct inode *ip, uint bn, int alloc)
 {
   uint addr, *a;
   struct buf *bp, *dbp, *tbp;
 
   if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[bn]) == 0 && alloc)
+      ip->addrs[bn] = addr = bmapalloc(ip);
     return addr;
   }
   bn -= NDIRECT;
 
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[NDIRECT]) == 0){
+      if(!alloc)
+        return 0;
+      ip->addrs[NDIRECT] = addr = bmapalloc(ip);
+    }
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+    if((addr = a[bn]) == 0 && alloc){
+      a[bn] = addr = bmapalloc(ip);
       log_write(bp);
     }
     brelse(bp);
@@ -401,22 +578,29 @@ bmap(struct inode *ip, uint bn)
   if(bn < NDBINDIRECT){
     //cprintf("c bn : %d\n",bn);
     // Load double indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT + 1]) == 0)
-      ip->addrs[NDIRECT + 1] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[NDIRECT + 1]) == 0){
+      if(!alloc)
+        return 0;
+      ip->addrs[NDIRECT + 1] = addr = bmapalloc(ip);
+    }
     dbp = bread(ip->dev, addr);
     a = (uint*)dbp->data;
 
     // Indirect pointer access.
     if((addr = a[bn / NINDIRECT]) == 0){
-      a[bn / NINDIRECT] = addr = balloc(ip->dev);
+      if(!alloc){
+        brelse(dbp);
+        return 0;
+      }
+      a[bn / NINDIRECT] = addr = bmapalloc(ip);
       log_write(dbp);
     }
 
     brelse(dbp);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[bn % NINDIRECT]) == 0){
-      a[bn % NINDIRECT] = addr = balloc(ip->dev);
+    if((addr = a[bn % NINDIRECT]) == 0 && alloc){
+      a[bn % NINDIRECT] = addr = bmapalloc(ip);
       log_write(bp);
     }
     brelse(bp);
@@ -427,15 +611,22 @@ bmap(struct inode *ip, uint bn)
   bn -= NDBINDIRECT;
   if(bn < NTRINDIRECT){
     // Load triple indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT + 2]) == 0)
-      ip->addrs[NDIRECT + 2] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[NDIRECT + 2]) == 0){
+      if(!alloc)
+        return 0;
+      ip->addrs[NDIRECT + 2] = addr = bmapalloc(ip);
+    }
     tbp = bread(ip->dev, addr);
     a = (uint*)tbp->data;
 
     // Double indirect pointer access.
     if((addr = a[bn / NDBINDIRECT]) == 0){
+      if(!alloc){
+        brelse(tbp);
+        return 0;
+      }
     //if((addr = a[bn / (NINDIRECT * NINDIRECT)]) == 0){
-      a[bn / NDBINDIRECT] = addr = balloc(ip->dev);
+      a[bn / NDBINDIRECT] = addr = bmapalloc(ip);
       log_write(tbp);
     }
 
@@ -444,14 +635,19 @@ bmap(struct inode *ip, uint bn)
 
     // Indirect pointer access.
     if((addr = a[(bn % NDBINDIRECT) / NINDIRECT]) == 0){
-     a[(bn % NDBINDIRECT) / NINDIRECT] = addr = balloc(ip->dev);
+      if(!alloc){
+        brelse(dbp);
+        brelse(tbp);
+        return 0;
+      }
+     a[(bn % NDBINDIRECT) / NINDIRECT] = addr = bmapalloc(ip);
      log_write(dbp);
     }
 
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
-    if((addr = a[(bn % NDBINDIRECT) % NINDIRECT]) == 0){
-      a[(bn % NDBINDIRECT) % NINDIRECT] = addr = balloc(ip->dev);
+    if((addr = a[(bn % NDBINDIRECT) % NINDIRECT]) == 0 && alloc){
+      a[(bn % NDBINDIRECT) % NINDIRECT] = addr = bmapalloc(ip);
       log_write(bp);
     }
 
@@ -568,7 +764,7 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addr;
   struct buf *bp;
 
   if(ip->type == T_DEV){
@@ -583,8 +779,12 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
+    if((addr = bmap(ip, off/BSIZE, 0)) == 0){
+      memset(dst, 0, m);  // hole
+      continue;
+    }
+    bp = bread(ip->dev, addr);
     memmove(dst, bp->data + off%BSIZE, m);
     brelse(bp);
   }
@@ -606,26 +806,114 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return devsw[ip->major].write(ip, src, n);
   }
 
-  if(off > ip->size || off + n < off)
+  // Writing past the end of the file leaves a hole between
+  // the old end and off; bmap() only allocates what we touch.
+  if(off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    bp = bread(ip->dev, bmap(ip, off/BSIZE, 1));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
     log_write(bp);
     brelse(bp);
   }
 
-  if(n > 0 && off > ip->size){
-    ip->size = off;
+  if(n > 0){
+    if(off > ip->size)
+      ip->size = off;
+    // write the i-node back even if the size didn't change,
+    // since bmap() may have filled a hole in ip->addrs[].
     iupdate(ip);
   }
   return n;
 }
 
+// Byte-range locks let writers that hold ip->lock only shared
+// overwrite disjoint parts of a file at the same time. A range
+// is [start, end); overlapping ranges wait for each other unless
+// both are shared. Readers holding ip->lock shared take their
+// range shared, so they never see a ranged write half done.
+static int
+irangebusy(struct inode *ip, uint start, uint end, int shared)
+{
+  struct irange *q;
+
+  for(q = ip->ranges; q; q = q->next)
+    if(q->start < end && start < q->end && !(shared && q->shared))
+      return 1;
+  return 0;
+}
+
+// Lock bytes [start, end) of ip, shared or not, using r to
+// record it.
+// Caller must hold ip->lock shared.
+void
+irangelock(struct inode *ip, struct irange *r, uint start, uint end, int shared)
+{
+  r->start = start;
+  r->end = end;
+  r->shared = shared;
+  acquire(&irangelk);
+  while(irangebusy(ip, start, end, shared))
+    sleep(&ip->ranges, &irangelk);
+  r->next = ip->ranges;
+  ip->ranges = r;
+  release(&irangelk);
+}
+
+void
+irangeunlock(struct inode *ip, struct irange *r)
+{
+  struct irange **pp;
+
+  acquire(&irangelk);
+  for(pp = &ip->ranges; *pp != r; pp = &(*pp)->next)
+    if(*pp == 0)
+      panic("irangeunlock");
+  *pp = r->next;
+  wakeup(&ip->ranges);
+  release(&irangelk);
+}
+
+// Can n bytes at off be overwritten in place: inside the file,
+// with every block already allocated?
+// Caller must hold ip->lock (shared is enough).
+int
+iallocated(struct inode *ip, uint off, uint n)
+{
+  uint bn;
+
+  if(ip->type == T_DEV || n == 0 || off + n < off || off + n > ip->size)
+    return 0;
+  for(bn = off/BSIZE; bn <= (off + n - 1)/BSIZE; bn++)
+    if(bmap(ip, bn, 0) == 0)
+      return 0;
+  return 1;
+}
+
+// Overwrite n bytes at off, all of which iallocated() has
+// vouched for, without changing the inode. Caller must hold
+// ip->lock shared and [off, off+n) with irangelock().
+void
+writeirange(struct inode *ip, char *src, uint off, uint n)
+{
+  uint tot, m, addr;
+  struct buf *bp;
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    if((addr = bmap(ip, off/BSIZE, 0)) == 0)
+      panic("writeirange");
+    bp = bread(ip->dev, addr);
+    m = min(n - tot, BSIZE - off%BSIZE);
+    memmove(bp->data + off%BSIZE, src, m);
+    log_write(bp);
+    brelse(bp);
+  }
+}
+
 //PAGEBREAK!
 // Directories
 
@@ -635,18 +923,110 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// A directory is a file containing a sequence of dirents that is
+// searched linearly.  When a linear directory has filled its first
+// block, dirlink() turns it into a hashed directory (DIR_HASHED in
+// its major): block 0 stays a linear area holding "." and ".." and
+// whatever else was already there, and further entries are hashed
+// into NDIRHASH one-block buckets following it.  A bucket is only
+// allocated once an entry lands in it; a full bucket overflows into
+// the next one, so a lookup probes successive buckets until it finds
+// the name or reaches a bucket with a never-used slot.  Unlinked
+// entries keep their name (with inum 0) so they don't end a probe.
+
+// Size of the part of dp that is searched linearly.
+static uint
+dirlinear(struct inode *dp)
+{
+  return dp->major == DIR_HASHED ? BSIZE : dp->size;
+}
+
+static uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 5381;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*33 + (uchar)name[i];
+  return h % NDIRHASH;
+}
+
+// Look for name in hash bucket b of dp.
+// Returns its inum and sets *poff if found, or 0.
+// Sets *vacant if the bucket has a never-used slot.
+static uint
+dirbucket(struct inode *dp, uint b, char *name, uint *poff, int *vacant)
+{
+  uint addr, inum;
+  int i;
+  struct buf *bp;
+  struct dirent *de;
+
+  *vacant = 0;
+  if((addr = bmap(dp, 1 + b, 0)) == 0){
+    *vacant = 1;  // not allocated yet
+    return 0;
+  }
+  bp = bread(dp->dev, addr);
+  de = (struct dirent*)bp->data;
+  inum = 0;
+  for(i = 0; i < DPB; i++){
+    if(de[i].inum == 0){
+      if(de[i].name[0] == 0)
+        *vacant = 1;
+      continue;
+    }
+    if(namecmp(name, de[i].name) == 0){
+      inum = de[i].inum;
+      if(poff)
+        *poff = (1 + b)*BSIZE + i*sizeof(*de);
+      break;
+    }
+  }
+  brelse(bp);
+  return inum;
+}
+
+// Return the offset of the first free slot on name's probe
+// sequence in hashed directory dp, or -1 if all buckets are full.
+static int
+dirslot(struct inode *dp, char *name)
+{
+  uint b, addr;
+  int i, j;
+  struct buf *bp;
+  struct dirent *de;
+
+  b = dirhash(name);
+  for(i = 0; i < NDIRHASH; i++, b = (b + 1) % NDIRHASH){
+    if((addr = bmap(dp, 1 + b, 0)) == 0)
+      return (1 + b)*BSIZE;  // writei() will allocate the bucket
+    bp = bread(dp->dev, addr);
+    de = (struct dirent*)bp->data;
+    for(j = 0; j < DPB && de[j].inum != 0; j++)
+      ;
+    brelse(bp);
+    if(j < DPB)
+      return (1 + b)*BSIZE + j*sizeof(*de);
+  }
+  return -1;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint off, inum, b;
+  int i, vacant;
   struct dirent de;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
+  for(off = 0; off < dirlinear(dp); off += sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
     if(de.inum == 0)
@@ -659,7 +1039,16 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       return iget(dp->dev, inum);
     }
   }
+  if(dp->major != DIR_HASHED)
+    return 0;
 
+  b = dirhash(name);
+  for(i = 0; i < NDIRHASH; i++, b = (b + 1) % NDIRHASH){
+    if((inum = dirbucket(dp, b, name, poff, &vacant)) != 0)
+      return iget(dp->dev, inum);
+    if(vacant)
+      break;
+  }
   return 0;
 }
 
@@ -678,21 +1067,263 @@ dirlink(struct inode *dp, char *name, uint inum)
   }
 
   // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
+  for(off = 0; off < dirlinear(dp); off += sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlink read");
     if(de.inum == 0)
       break;
   }
 
+  if(off == BSIZE && dp->size == BSIZE && dp->major != DIR_HASHED){
+    // The first block is full: switch to hashing.
+    dp->major = DIR_HASHED;
+    dp->size = (1 + NDIRHASH)*BSIZE;
+    iupdate(dp);
+  }
+  if(dp->major == DIR_HASHED && off == BSIZE){
+    if((off = dirslot(dp, name)) < 0)
+      return -1;
+  }
+
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcinsert(dp, name, inum);
 
   return 0;
 }
 
+//PAGEBREAK!
+// Name cache
+//
+// namex() consults dcache before scanning a directory.  An entry
+// maps (dev, directory inum, name) to the inum the name refers to,
+// or to 0 if the directory is known not to contain the name.
+// Entries are chained from hash buckets for lookup and kept on an
+// LRU list, like the buffer cache, for recycling.
+//
+// The caller must hold the directory's ip->lock, the same lock
+// that dirlink() and unlink hold while changing the directory, so
+// an entry can't go stale between a directory scan and dcinsert().
+// dirlink() and unlink update the names they change, and iput()
+// drops every entry under a directory it frees.
+//
+// Lookups take no lock: they walk the hash chains under RCU.
+// Changes are made under dcache.lock, and an entry unlinked from
+// its chain is not rewritten until a grace period has passed, in
+// case a lookup on another CPU is still reading it. Lookups only
+// set the entry's used flag, and recycling gives used entries a
+// second chance, instead of moving them on the LRU list.
+
+#define NDCACHE 128
+#define NDCHASH 64
+
+struct dentry {
+  uint dev;
+  uint dinum;           // directory the name is in; 0 if entry unused
+  char name[DIRSIZ];
+  uint inum;            // what name refers to; 0 if absent
+  int used;             // looked up since last considered for recycling
+  uint gp;              // if unused, RCU grace period before reuse
+  struct dentry *hnext; // hash chain
+  struct dentry *prev;  // LRU list
+  struct dentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry dentry[NDCACHE];
+  struct dentry *hash[NDCHASH];
+
+  // Linked list of all entries, through prev/next.
+  // head.next is most recently inserted.
+  struct dentry head;
+  int nfree;            // entries not on a hash chain
+} dcache;
+
+#define DCSLACK 8       // unlinked entries kept ready for reuse
+
+static void
+dcinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for(d = dcache.dentry; d < dcache.dentry+NDCACHE; d++){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+  dcache.nfree = NDCACHE;
+}
+
+static struct dentry**
+dchash(uint dev, uint dinum, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev*31 + dinum;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*33 + (uchar)name[i];
+  return &dcache.hash[h % NDCHASH];
+}
+
+// Find the entry for name in directory dp.
+// Caller must hold dcache.lock or be in an RCU read section.
+static struct dentry*
+dcfind(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  for(d = rcu_deref(*dchash(dp->dev, dp->inum, name)); d; d = rcu_deref(d->hnext))
+    if(d->dinum == dp->inum && d->dev == dp->dev && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Move d to the head of the MRU list.
+// Caller must hold dcache.lock.
+static void
+dctouch(struct dentry *d)
+{
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  d->next = dcache.head.next;
+  d->prev = &dcache.head;
+  dcache.head.next->prev = d;
+  dcache.head.next = d;
+}
+
+// Take d off its hash chain and make it the next to be recycled.
+// d->hnext is left alone so that lookups standing on d can carry on.
+// Caller must hold dcache.lock.
+static void
+dcremove(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = dchash(d->dev, d->dinum, d->name); *pp != d; pp = &(*pp)->hnext)
+    ;
+  rcu_assign(*pp, d->hnext);
+  d->dinum = 0;
+  d->gp = rcu_gpstart();
+  dcache.nfree++;
+
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  d->prev = dcache.head.prev;
+  d->next = &dcache.head;
+  dcache.head.prev->next = d;
+  dcache.head.prev = d;
+}
+
+// Look name up in the cache for directory dp.
+// Returns 1 and sets *pinum (0 for a known-absent name) on a hit,
+// 0 on a miss.  Caller must hold dp->lock.
+static int
+dclookup(struct inode *dp, char *name, uint *pinum)
+{
+  struct dentry *d;
+  int hit;
+
+  hit = 0;
+  rcu_read_lock();
+  if((d = dcfind(dp, name)) != 0){
+    *pinum = d->inum;
+    d->used = 1;
+    hit = 1;
+  }
+  rcu_read_unlock();
+  return hit;
+}
+
+// Find an entry that can be reused: off its hash chain with its
+// grace period over. To keep some ready, unlink the coldest entries
+// not looked up since they were last passed over.
+// Returns 0 if nothing is reusable yet.
+// Caller must hold dcache.lock.
+static struct dentry*
+dcalloc(void)
+{
+  struct dentry *d, *prev, *free;
+
+  free = 0;
+  for(d = dcache.head.prev; d != &dcache.head; d = prev){
+    prev = d->prev;  // dcremove() moves d to the tail
+    if(d->dinum == 0){
+      if(free == 0 && rcu_gpdone(d->gp))
+        free = d;
+    } else if(dcache.nfree <= DCSLACK){
+      if(d->used)
+        d->used = 0;
+      else
+        dcremove(d);
+    } else if(free)
+      break;
+  }
+  if(free)
+    dcache.nfree--;
+  return free;
+}
+
+// Record that name in directory dp refers to inum (0: absent).
+// Caller must hold dp->lock.
+static void
+dcinsert(struct inode *dp, char *name, uint inum)
+{
+  struct dentry *d, **pp;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dp, name)) == 0){
+    if((d = dcalloc()) == 0){
+      release(&dcache.lock);
+      return;
+    }
+    d->dev = dp->dev;
+    d->dinum = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    d->inum = inum;
+    d->used = 0;
+    pp = dchash(d->dev, d->dinum, d->name);
+    d->hnext = *pp;
+    rcu_assign(*pp, d);
+  } else
+    d->inum = inum;
+  dctouch(d);
+  release(&dcache.lock);
+}
+
+// Forget what is known about name in directory dp.
+// Caller must hold dp->lock.
+void
+dcinvalidate(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dp, name)) != 0)
+    dcremove(d);
+  release(&dcache.lock);
+}
+
+// Forget every name in directory dp, which is being freed.
+static void
+dcpurge(struct inode *dp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.dentry; d < dcache.dentry+NDCACHE; d++)
+    if(d->dinum == dp->inum && d->dev == dp->dev)
+      dcremove(d);
+  release(&dcache.lock);
+}
+
 //PAGEBREAK!
 // Paths
 
@@ -741,6 +1372,7 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  uint inum;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
@@ -748,21 +1380,29 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    // Lookups only read the directory, so walks through
+    // the same directory can run side by side.
+    ilockshared(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlockshared(ip);
+      iput(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      iunlock(ip);
+      iunlockshared(ip);
       return ip;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
-      return 0;
+    if(dclookup(ip, name, &inum))
+      next = inum ? iget(ip->dev, inum) : 0;
+    else {
+      next = dirlookup(ip, name, 0);
+      dcinsert(ip, name, next ? next->inum : 0);
     }
-    iunlockput(ip);
+    iunlockshared(ip);
+    iput(ip);
+    if(next == 0)
+      return 0;
     ip = next;
   }
   if(nameiparent){
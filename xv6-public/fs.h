@@ -57,3 +57,12 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Dirents per block
+#define DPB           (BSIZE / sizeof(struct dirent))
+
+// A T_DIR inode's major (otherwise unused) records its format:
+// 0 for a linear directory, DIR_HASHED for a hashed one whose
+// block 0 is followed by NDIRHASH hash buckets (see fs.c).
+#define DIR_HASHED 1
+#define NDIRHASH   1024
+
@@ -0,0 +1,131 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "futex.h"
+
+#define NUM_THREAD 5
+#define NUM_INCR   100000
+
+// A mutex that sleeps in the kernel when contended.
+// 0: unlocked, 1: locked, 2: locked with possible waiters.
+int lockword;
+int gcnt;
+int go;
+
+int
+cas(volatile int *addr, int old, int new)
+{
+  int prev;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (prev), "+m" (*addr) :
+               "r" (new), "0" (old) :
+               "memory");
+  return prev;
+}
+
+int
+xchg(volatile int *addr, int new)
+{
+  asm volatile("lock; xchgl %0, %1" :
+               "+m" (*addr), "+r" (new) :
+               :
+               "memory");
+  return new;
+}
+
+void
+mutex_lock(int *m)
+{
+  int c;
+
+  if((c = cas(m, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = xchg(m, 2);
+  while(c != 0){
+    futex(m, FUTEX_WAIT, 2);
+    c = xchg(m, 2);
+  }
+}
+
+void
+mutex_unlock(int *m)
+{
+  if(xchg(m, 0) == 2)
+    futex(m, FUTEX_WAKE, 1);
+}
+
+void*
+mutexthreadmain(void *arg)
+{
+  int i, tmp;
+
+  for(i = 0; i < NUM_INCR; i++){
+    mutex_lock(&lockword);
+    tmp = gcnt;
+    tmp++;
+    gcnt = tmp;
+    mutex_unlock(&lockword);
+  }
+  thread_exit(arg);
+}
+
+void*
+waitthreadmain(void *arg)
+{
+  while(*(volatile int*)&go == 0)
+    futex(&go, FUTEX_WAIT, 0);
+  thread_exit(arg);
+}
+
+int
+main(int argc, char *argv[])
+{
+  thread_t threads[NUM_THREAD];
+  void *retval;
+  int i, woken;
+
+  printf(1, "1. futex mutex test\n");
+  for(i = 0; i < NUM_THREAD; i++)
+    if(thread_create(&threads[i], mutexthreadmain, (void*)i) != 0){
+      printf(1, "thread_create failed\n");
+      exit();
+    }
+  for(i = 0; i < NUM_THREAD; i++)
+    if(thread_join(threads[i], &retval) != 0){
+      printf(1, "thread_join failed\n");
+      exit();
+    }
+  if(gcnt != NUM_THREAD * NUM_INCR){
+    printf(1, "lost updates: %d\n", gcnt);
+    exit();
+  }
+
+  printf(1, "2. futex wake test\n");
+  if(futex(&go, FUTEX_WAIT, 1) != -1){
+    printf(1, "wait on a changed value slept\n");
+    exit();
+  }
+  for(i = 0; i < NUM_THREAD; i++)
+    if(thread_create(&threads[i], waitthreadmain, (void*)i) != 0){
+      printf(1, "thread_create failed\n");
+      exit();
+    }
+  sleep(10);
+  // A thread that hasn't slept yet will find go set and not
+  // sleep, so one wake after the store is enough.
+  go = 1;
+  if((woken = futex(&go, FUTEX_WAKE, NUM_THREAD)) < 0 || woken > NUM_THREAD){
+    printf(1, "futex wake returned %d\n", woken);
+    exit();
+  }
+  for(i = 0; i < NUM_THREAD; i++)
+    if(thread_join(threads[i], &retval) != 0){
+      printf(1, "thread_join failed\n");
+      exit();
+    }
+
+  printf(1, "futextest ok\n");
+  exit();
+}
@@ -0,0 +1,39 @@
+// Batched system calls through a ring in user memory.
+//
+// The program fills sq[] entries and advances sq_tail, then
+// calls io_enter() to have the kernel run them. For each entry
+// run, the kernel advances sq_head and appends a completion to
+// cq[], advancing cq_tail; the program consumes completions by
+// advancing cq_head. Indexes run freely and are taken modulo
+// IORING_ENTRIES.
+#define IORING_ENTRIES 32  // must be a power of two
+
+#define IORING_OP_READ   1  // read(fd, addr, len)
+#define IORING_OP_WRITE  2  // write(fd, addr, len)
+#define IORING_OP_PREAD  3  // pread(fd, addr, len, off)
+#define IORING_OP_PWRITE 4  // pwrite(fd, addr, len, off)
+#define IORING_OP_OPEN   5  // open(addr, len), len being the mode
+#define IORING_OP_CLOSE  6  // close(fd)
+
+struct io_sqe {
+  int opcode;
+  int fd;
+  char *addr;
+  int len;
+  int off;
+  int user_data;   // copied to the completion
+};
+
+struct io_cqe {
+  int user_data;
+  int res;         // what the system call would have returned
+};
+
+struct io_ring {
+  uint sq_head;    // advanced by the kernel
+  uint sq_tail;    // advanced by the program
+  uint cq_head;    // advanced by the program
+  uint cq_tail;    // advanced by the kernel
+  struct io_sqe sq[IORING_ENTRIES];
+  struct io_cqe cq[IORING_ENTRIES];
+};
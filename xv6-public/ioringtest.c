@@ -0,0 +1,119 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "ioring.h"
+
+#define NWRITE 2000  // 16-byte writes in the timing test
+
+struct io_ring ring;
+char buf[16*IORING_ENTRIES];
+char rbuf[16*IORING_ENTRIES];
+
+void
+fail(char *msg)
+{
+  printf(1, "ioringtest: %s\n", msg);
+  exit();
+}
+
+void
+submit(int op, int fd, char *addr, int len, int off, int user_data)
+{
+  struct io_sqe *sqe;
+
+  if(ring.sq_tail - ring.sq_head >= IORING_ENTRIES)
+    fail("submission queue full");
+  sqe = &ring.sq[ring.sq_tail % IORING_ENTRIES];
+  sqe->opcode = op;
+  sqe->fd = fd;
+  sqe->addr = addr;
+  sqe->len = len;
+  sqe->off = off;
+  sqe->user_data = user_data;
+  ring.sq_tail++;
+}
+
+// Run everything queued and check that completion i has
+// user_data i and result res.
+void
+runall(int n, int res)
+{
+  struct io_cqe *cqe;
+  int i;
+
+  if(io_enter(n) != n)
+    fail("io_enter did not run every entry");
+  for(i = 0; i < n; i++){
+    cqe = &ring.cq[ring.cq_head % IORING_ENTRIES];
+    if(cqe->user_data != i || cqe->res != res){
+      printf(1, "completion %d: user_data %d res %d\n", i, cqe->user_data, cqe->res);
+      fail("bad completion");
+    }
+    ring.cq_head++;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, p[2], start, t1, t2;
+  struct io_cqe *cqe;
+
+  printf(1, "ioringtest starting\n");
+  if(io_setup(&ring) < 0)
+    fail("io_setup failed");
+
+  printf(1, "1. file test\n");
+  submit(IORING_OP_OPEN, 0, "ioringtest.f", O_CREATE | O_RDWR, 0, 0);
+  if(io_enter(1) != 1)
+    fail("io_enter failed");
+  cqe = &ring.cq[ring.cq_head++ % IORING_ENTRIES];
+  if((fd = cqe->res) < 0)
+    fail("open failed");
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  for(i = 0; i < IORING_ENTRIES; i++)
+    submit(IORING_OP_PWRITE, fd, buf + 16*i, 16, 16*i, i);
+  runall(IORING_ENTRIES, 16);
+  for(i = 0; i < IORING_ENTRIES; i++)
+    submit(IORING_OP_PREAD, fd, rbuf + 16*i, 16, 16*i, i);
+  runall(IORING_ENTRIES, 16);
+  for(i = 0; i < sizeof(buf); i++)
+    if(rbuf[i] != buf[i])
+      fail("read back wrong data");
+  submit(IORING_OP_CLOSE, fd, 0, 0, 0, 0);
+  runall(1, 0);
+  submit(IORING_OP_CLOSE, fd, 0, 0, 0, 0);
+  runall(1, -1);
+  unlink("ioringtest.f");
+
+  printf(1, "2. batching test\n");
+  if(pipe(p) < 0 || fcntl(p[1], F_SETPIPE_SZ, NWRITE*16) < 0)
+    fail("pipe setup failed");
+  start = uptime();
+  for(i = 0; i < NWRITE; i++)
+    if(write(p[1], buf, 16) != 16)
+      fail("write failed");
+  t1 = uptime() - start;
+  for(i = 0; i < NWRITE; i += 16)
+    read(p[0], rbuf, 16*16);
+  start = uptime();
+  for(i = 0; i < NWRITE; i++){
+    submit(IORING_OP_WRITE, p[1], buf, 16, 0, 0);
+    if(ring.sq_tail - ring.sq_head == IORING_ENTRIES || i == NWRITE-1){
+      io_enter(IORING_ENTRIES);
+      while(ring.cq_head != ring.cq_tail)
+        if(ring.cq[ring.cq_head++ % IORING_ENTRIES].res != 16)
+          fail("ring write failed");
+    }
+  }
+  t2 = uptime() - start;
+  printf(1, "%d writes: %d ticks with write(), %d ticks through the ring\n",
+         NWRITE, t1, t2);
+  close(p[0]);
+  close(p[1]);
+
+  printf(1, "ioringtest ok\n");
+  exit();
+}
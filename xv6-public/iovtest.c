@@ -0,0 +1,103 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "uio.h"
+
+char *filepath = "iovtest.f";
+char payload[3000];
+char hdr[8], body[3000], tail[8];
+
+int
+same(char *a, char *b, int n)
+{
+  while(n-- > 0)
+    if(*a++ != *b++)
+      return 0;
+  return 1;
+}
+
+void
+fail(char *msg)
+{
+  printf(1, "iovtest: %s\n", msg);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct iovec iov[3];
+  int fd, p[2], i;
+
+  printf(1, "iovtest starting\n");
+  for(i = 0; i < sizeof(payload); i++)
+    payload[i] = 'a' + i % 26;
+
+  printf(1, "1. writev/readv test\n");
+  if((fd = open(filepath, O_CREATE | O_RDWR)) < 0)
+    fail("open failed");
+  iov[0].iov_base = "HEADER:";
+  iov[0].iov_len = 7;
+  iov[1].iov_base = payload;
+  iov[1].iov_len = sizeof(payload);
+  iov[2].iov_base = ":END";
+  iov[2].iov_len = 4;
+  if(writev(fd, iov, 3) != 7 + sizeof(payload) + 4)
+    fail("writev failed");
+  close(fd);
+
+  if((fd = open(filepath, O_RDONLY)) < 0)
+    fail("open failed");
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = 7;
+  iov[1].iov_base = body;
+  iov[1].iov_len = sizeof(payload);
+  iov[2].iov_base = tail;
+  iov[2].iov_len = sizeof(tail);
+  if(readv(fd, iov, 3) != 7 + sizeof(payload) + 4)
+    fail("readv failed");
+  if(!same(hdr, "HEADER:", 7) || !same(body, payload, sizeof(payload)) ||
+     !same(tail, ":END", 4))
+    fail("readv returned wrong data");
+  close(fd);
+
+  printf(1, "2. pwritev/preadv test\n");
+  if((fd = open(filepath, O_RDWR)) < 0)
+    fail("open failed");
+  iov[0].iov_base = "xy";
+  iov[0].iov_len = 2;
+  iov[1].iov_base = "zw";
+  iov[1].iov_len = 2;
+  if(pwritev(fd, iov, 2, 3) != 4)
+    fail("pwritev failed");
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = 3;
+  iov[1].iov_base = tail;
+  iov[1].iov_len = 4;
+  if(preadv(fd, iov, 2, 0) != 7 || !same(hdr, "HEA", 3) || !same(tail, "xyzw", 4))
+    fail("preadv returned wrong data");
+  close(fd);
+  unlink(filepath);
+
+  printf(1, "3. pipe test\n");
+  if(pipe(p) < 0)
+    fail("pipe failed");
+  iov[0].iov_base = "ping";
+  iov[0].iov_len = 4;
+  iov[1].iov_base = "pong";
+  iov[1].iov_len = 4;
+  if(writev(p[1], iov, 2) != 8)
+    fail("writev to pipe failed");
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = 6;
+  iov[1].iov_base = tail;
+  iov[1].iov_len = 2;
+  if(readv(p[0], iov, 2) != 8 || !same(hdr, "pingpo", 6) || !same(tail, "ng", 2))
+    fail("readv from pipe returned wrong data");
+  close(p[0]);
+  close(p[1]);
+
+  printf(1, "iovtest ok\n");
+  exit();
+}
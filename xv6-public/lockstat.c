@@ -0,0 +1,95 @@
+// Print per-lock contention counters, most contended first.
+//
+// lockstat -p [cmd args...]
+//   With a command, profile the locks while it runs; without,
+//   print what the profiler has collected so far. The profile
+//   is split by acquire() caller; look the pc up in kernel.asm.
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+#define NTOP 20  // locks and profile entries printed
+
+struct lockstat st[NLOCKSTAT];
+struct lockprof lp[NLOCKPROF];
+
+void
+printstat(void)
+{
+  struct lockstat tmp;
+  int n, i, j;
+
+  if((n = getlockstat(st, NLOCKSTAT)) < 0){
+    printf(2, "lockstat: getlockstat failed\n");
+    exit();
+  }
+
+  // Insertion sort by number of contended acquires.
+  for(i = 1; i < n; i++){
+    tmp = st[i];
+    for(j = i; j > 0 && st[j-1].ncontend < tmp.ncontend; j--)
+      st[j] = st[j-1];
+    st[j] = tmp;
+  }
+
+  printf(1, "name            lock      acquire  contend  spin  maxhold\n");
+  for(i = 0; i < n && i < NTOP; i++)
+    printf(1, "%s\t%x\t%d\t%d\t%d\t%d\n", st[i].name, st[i].lock,
+           st[i].nacquire, st[i].ncontend, st[i].nspin, st[i].maxhold);
+}
+
+void
+printprof(void)
+{
+  struct lockprof tmp;
+  int n, i, j;
+
+  if((n = lockprof(LOCKPROF_READ, lp, NLOCKPROF)) < 0){
+    printf(2, "lockstat: lockprof failed\n");
+    exit();
+  }
+
+  // Insertion sort by time spent waiting, then holding.
+  for(i = 1; i < n; i++){
+    tmp = lp[i];
+    for(j = i; j > 0 && (lp[j-1].wait < tmp.wait ||
+        (lp[j-1].wait == tmp.wait && lp[j-1].hold < tmp.hold)); j--)
+      lp[j] = lp[j-1];
+    lp[j] = tmp;
+  }
+
+  printf(1, "name            pc        acquire  contend  wait(kcyc)  hold(kcyc)\n");
+  for(i = 0; i < n && i < NTOP; i++)
+    printf(1, "%s\t%x\t%d\t%d\t%d\t%d\n", lp[i].name, lp[i].pc,
+           lp[i].nacquire, lp[i].ncontend, lp[i].wait, lp[i].hold);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid;
+
+  if(argc < 2 || strcmp(argv[1], "-p") != 0){
+    printstat();
+    exit();
+  }
+
+  if(argc > 2){
+    lockprof(LOCKPROF_RESET, 0, 0);
+    lockprof(LOCKPROF_ENABLE, 0, 0);
+    if((pid = fork()) < 0){
+      printf(2, "lockstat: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[2], argv + 2);
+      printf(2, "lockstat: exec %s failed\n", argv[2]);
+      exit();
+    }
+    wait();
+    lockprof(LOCKPROF_DISABLE, 0, 0);
+  }
+  printprof();
+  exit();
+}
@@ -0,0 +1,32 @@
+// Contention counters for one spin lock.
+// Returned to user space by getlockstat().
+struct lockstat {
+  char name[16];     // Name passed to initlock()
+  uint lock;         // Kernel address of the lock
+  uint nacquire;     // Number of acquire() calls
+  uint ncontend;     // Acquires that had to wait
+  uint nspin;        // Total spin iterations while waiting
+  uint maxhold;      // Longest hold, in TSC cycles
+};
+
+#define NLOCKSTAT 512  // most locks getlockstat() returns
+
+// Lock profile entry: time spent waiting for and holding a lock
+// name, split by the code that acquired it. Times are in units
+// of 1024 TSC cycles. Returned by lockprof(LOCKPROF_READ, ...).
+struct lockprof {
+  char name[16];     // Lock name
+  uint pc;           // Caller of acquire()
+  uint nacquire;     // Acquires from pc
+  uint ncontend;     // Of those, how many had to wait
+  uint wait;         // Total time waiting
+  uint hold;         // Total time holding
+};
+
+#define NLOCKPROF 128  // (name, pc) pairs profiled per CPU
+
+// lockprof() commands
+#define LOCKPROF_ENABLE  1
+#define LOCKPROF_DISABLE 2
+#define LOCKPROF_RESET   3  // clears the profile, not getlockstat() counters
+#define LOCKPROF_READ    4
@@ -1,22 +1,33 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
+#include "fcntl.h"
 
-#define PIPESIZE 512
+#define PIPEMAXPAGES 16  // largest pipe is 64KB
 
+// The ring is made of size/PGSIZE separately kalloc'd pages;
+// size is always a power of two. Bytes move in runs that stay
+// within one page, so a transfer is a few memmove()s rather than
+// a loop over bytes.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *data[PIPEMAXPAGES];
+  uint size;      // capacity in bytes
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int nreadwait;  // readers sleeping on nread
+  int nwritewait; // writers sleeping on nwrite
+  struct waitq wq;  // poll() callers
 };
 
 int
@@ -30,6 +41,10 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(p, 0, sizeof(*p));
+  if((p->data[0] = kalloc()) == 0)
+    goto bad;
+  p->size = PGSIZE;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
@@ -56,6 +71,17 @@ pipealloc(struct file **f0, struct file **f1)
   return -1;
 }
 
+static void
+pipefree(struct pipe *p)
+{
+  int i;
+
+  freelock(&p->lock);
+  for(i = 0; i < p->size / PGSIZE; i++)
+    kfree(p->data[i]);
+  kfree((char*)p);
+}
+
 void
 pipeclose(struct pipe *p, int writable)
 {
@@ -67,40 +93,136 @@ pipeclose(struct pipe *p, int writable)
     p->readopen = 0;
     wakeup(&p->nwrite);
   }
+  if(p->wq.head)
+    waitqwake(&p->wq, writable ? POLLHUP : POLLERR);
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    pipefree(p);
   } else
     release(&p->lock);
 }
 
+// Address of byte off of the ring, and in *m how many bytes
+// from there on are contiguous (at most the rest of the page).
+static char*
+pipeaddr(struct pipe *p, uint off, uint *m)
+{
+  off &= p->size - 1;
+  *m = PGSIZE - off % PGSIZE;
+  return p->data[off / PGSIZE] + off % PGSIZE;
+}
+
+// Can the page at addr be flipped with a ring page rather
+// than copied? It must be a page-aligned user address (not a
+// kernel buffer, as filesend() passes) in a process with no
+// other threads, since swapupage() only flushes this CPU's TLB.
+static int
+pipeflippable(char *addr)
+{
+  struct proc *curproc = myproc();
+
+  return (uint)addr < KERNBASE && (uint)addr % PGSIZE == 0 &&
+    curproc->tid == 0 && curproc->num_of_threads == 0;
+}
+
+// Ring page holding byte off.
+static char**
+pipeslot(struct pipe *p, uint off)
+{
+  return &p->data[(off & (p->size - 1)) / PGSIZE];
+}
+
 //PAGEBREAK: 40
-int
-pipewrite(struct pipe *p, char *addr, int n)
+// Write n bytes at addr into the pipe. If gift is set, whole
+// pages of addr that line up with a free ring page are moved
+// into the ring instead of copied, and the caller is left with
+// a zeroed page in their place. If nonblock is set, write only
+// what fits without sleeping.
+static int
+pipeput(struct pipe *p, char *addr, int n, int gift, int nonblock)
 {
   int i;
+  uint m, contig;
+  char *dst;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
+  i = 0;
+  while(i < n){
+    while(p->nwrite == p->nread + p->size){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
+        if(i > 0){
+          n = i;  // report what was written
+          goto out;
+        }
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
+      if(nonblock){
+        n = i > 0 ? i : EWOULDBLOCK;
+        goto out;
+      }
+      if(p->nreadwait)
+        wakeup(&p->nread);
+      if(p->wq.head)
+        waitqwake(&p->wq, POLLIN);
+      p->nwritewait++;
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      p->nwritewait--;
+    }
+    m = p->nread + p->size - p->nwrite;
+    if(m > n - i)
+      m = n - i;
+    if(gift && m >= PGSIZE && p->nwrite % PGSIZE == 0 &&
+       pipeflippable(addr + i)){
+      dst = *pipeslot(p, p->nwrite);
+      memset(dst, 0, PGSIZE);
+      if(swapupage(myproc()->pgdir, addr + i, pipeslot(p, p->nwrite)) == 0){
+        uvmchanged(myproc());
+        p->nwrite += PGSIZE;
+        i += PGSIZE;
+        continue;
+      }
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    dst = pipeaddr(p, p->nwrite, &contig);
+    if(m > contig)
+      m = contig;
+    memmove(dst, addr + i, m);
+    p->nwrite += m;
+    i += m;
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+ out:
+  if(p->nreadwait)
+    wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  if(p->wq.head)
+    waitqwake(&p->wq, POLLIN);
   release(&p->lock);
   return n;
 }
 
 int
-piperead(struct pipe *p, char *addr, int n)
+pipewrite(struct pipe *p, char *addr, int n, int nonblock)
+{
+  return pipeput(p, addr, n, 0, nonblock);
+}
+
+// Like pipewrite(), but may take whole pages from the
+// calling process rather than copying them.
+int
+pipegift(struct pipe *p, char *addr, int n, int nonblock)
+{
+  return pipeput(p, addr, n, 1, nonblock);
+}
+
+// Read up to n bytes into addr. Whole pages that line up with
+// a page-aligned user buffer are flipped into the reader's
+// address space instead of copied; the reader's old page
+// becomes part of the ring.
+int
+piperead(struct pipe *p, char *addr, int n, int nonblock)
 {
   int i;
+  uint m, contig;
+  char *src;
 
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
@@ -108,14 +230,127 @@ piperead(struct pipe *p, char *addr, int n)
       release(&p->lock);
       return -1;
     }
+    if(nonblock){
+      release(&p->lock);
+      return EWOULDBLOCK;
+    }
+    p->nreadwait++;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+    p->nreadwait--;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  for(i = 0; i < n && p->nread != p->nwrite; i += m){  //DOC: piperead-copy
+    m = p->nwrite - p->nread;
+    if(m > n - i)
+      m = n - i;
+    if(m >= PGSIZE && p->nread % PGSIZE == 0 && pipeflippable(addr + i) &&
+       swapupage(myproc()->pgdir, addr + i, pipeslot(p, p->nread)) == 0){
+      uvmchanged(myproc());
+      m = PGSIZE;
+      p->nread += m;
+      continue;
+    }
+    src = pipeaddr(p, p->nread, &contig);
+    if(m > contig)
+      m = contig;
+    memmove(addr + i, src, m);
+    p->nread += m;
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  if(p->nwritewait)
+    wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  if(p->wq.head)
+    waitqwake(&p->wq, POLLOUT);
   release(&p->lock);
   return i;
 }
+
+// Capacity of the pipe in bytes.
+int
+pipegetsize(struct pipe *p)
+{
+  int n;
+
+  acquire(&p->lock);
+  n = p->size;
+  release(&p->lock);
+  return n;
+}
+
+// Change the capacity of the pipe to at least n bytes, rounded
+// up to a power-of-two number of pages. Fails if n is too large
+// or the data already in the pipe would not fit.
+// Returns the new capacity.
+int
+pipesetsize(struct pipe *p, int n)
+{
+  char *data[PIPEMAXPAGES], *src;
+  uint size, used, i, m, contig;
+
+  if(n < 0 || n > PIPEMAXPAGES*PGSIZE)
+    return -1;
+  for(size = PGSIZE; size < n; size *= 2)
+    ;
+  for(i = 0; i < size / PGSIZE; i++){
+    if((data[i] = kalloc()) == 0){
+      while(i-- > 0)
+        kfree(data[i]);
+      return -1;
+    }
+  }
+
+  acquire(&p->lock);
+  used = p->nwrite - p->nread;
+  if(used > size){
+    release(&p->lock);
+    for(i = 0; i < size / PGSIZE; i++)
+      kfree(data[i]);
+    return -1;
+  }
+  // Copy the unread bytes to the start of the new ring.
+  for(i = 0; i < used; i += m){
+    m = used - i;
+    src = pipeaddr(p, p->nread + i, &contig);
+    if(m > contig)
+      m = contig;
+    if(m > PGSIZE - i % PGSIZE)
+      m = PGSIZE - i % PGSIZE;
+    memmove(data[i / PGSIZE] + i % PGSIZE, src, m);
+  }
+  for(i = 0; i < p->size / PGSIZE; i++)
+    kfree(p->data[i]);
+  for(i = 0; i < size / PGSIZE; i++)
+    p->data[i] = data[i];
+  p->size = size;
+  p->nread = 0;
+  p->nwrite = used;
+  if(p->nwritewait)
+    wakeup(&p->nwrite);
+  if(p->wq.head)
+    waitqwake(&p->wq, POLLOUT);
+  release(&p->lock);
+  return size;
+}
+
+// Report which poll() events hold for one end of the pipe,
+// and queue ps to hear about changes.
+int
+pipepoll(struct pipe *p, int writable, struct pollent *pe)
+{
+  int mask;
+
+  acquire(&p->lock);
+  pollregister(&p->wq, pe);
+  mask = 0;
+  if(writable){
+    if(p->readopen == 0)
+      mask |= POLLERR;
+    else if(p->nwrite != p->nread + p->size)
+      mask |= POLLOUT;
+  } else {
+    if(p->nread != p->nwrite)
+      mask |= POLLIN;
+    if(p->writeopen == 0)
+      mask |= POLLHUP;
+  }
+  release(&p->lock);
+  return mask;
+}
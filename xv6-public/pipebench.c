@@ -0,0 +1,94 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define TOTAL (4*1024*1024)  // bytes sent per run
+
+#define PGSIZE 4096
+
+char *buf;  // page-aligned, so reads can flip pages
+
+// Send TOTAL bytes through a pipe of the given capacity in
+// chunk-sized writes and report how long it took. With gift
+// set the writer uses vmsplice(), and each page carries its
+// page number in its first byte so the reader can check it.
+void
+run(int pipesz, int chunk, int gift)
+{
+  int fds[2], pid, n, total, start, t, i;
+
+  if(pipe(fds) < 0){
+    printf(1, "pipe failed\n");
+    exit();
+  }
+  if(pipesz && fcntl(fds[1], F_SETPIPE_SZ, pipesz) < 0){
+    printf(1, "F_SETPIPE_SZ %d failed\n", pipesz);
+    exit();
+  }
+  pipesz = fcntl(fds[1], F_GETPIPE_SZ, 0);
+
+  start = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(total = 0; total < TOTAL; total += chunk){
+      if(gift){
+        for(i = 0; i < chunk; i += PGSIZE)
+          buf[i] = (total + i) / PGSIZE;
+        n = vmsplice(fds[1], buf, chunk);
+      } else
+        n = write(fds[1], buf, chunk);
+      if(n != chunk){
+        printf(1, "write failed\n");
+        exit();
+      }
+    }
+    exit();
+  }
+  close(fds[1]);
+  total = 0;
+  while((n = read(fds[0], buf, 2*PGSIZE)) > 0){
+    for(i = 0; gift && i < n; i += PGSIZE){
+      if(buf[i] != (char)((total + i) / PGSIZE)){
+        printf(1, "bad data at %d\n", total + i);
+        exit();
+      }
+    }
+    total += n;
+  }
+  close(fds[0]);
+  wait();
+  t = uptime() - start;
+  if(total != TOTAL){
+    printf(1, "read %d bytes, expected %d\n", total, TOTAL);
+    exit();
+  }
+  printf(1, "pipe %d bytes, %s of %d: %d ticks\n", pipesz,
+         gift ? "vmsplices" : "writes", chunk, t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+  int chunks[] = { 512, 4096, 8192 };
+  int sizes[] = { 0, 16384, 65536 };
+
+  buf = sbrk(3*PGSIZE);
+  buf += PGSIZE - (uint)buf % PGSIZE;
+
+  printf(1, "pipebench starting (%d bytes per run)\n", TOTAL);
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+    run(sizes[i], chunks[0], 0);
+    run(sizes[i], chunks[1], 0);
+    run(sizes[i], chunks[2], 0);
+    run(sizes[i], chunks[2], 1);
+  }
+  printf(1, "pipebench ok\n");
+  exit();
+}
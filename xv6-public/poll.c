@@ -0,0 +1,465 @@
+// Waiting for any of several files to become ready.
+//
+// poll() asks each file for its current state with filepoll(),
+// which also puts a pollent on the wait queue of the object
+// behind the file. If nothing is ready it sleeps until one of
+// those objects calls waitqwake(), then takes every entry off
+// its queue and looks again.
+//
+// An epoll instance keeps its pollents queued between calls
+// instead. Each wakeup moves the matching item onto the
+// instance's ready list, so epoll_wait() only looks at items
+// that may be ready.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "poll.h"
+
+struct spinlock polllock;
+
+// State of one poll() call.
+struct pollset {
+  int woken;               // set by pollsetwake()
+  struct pollent ent[NOFILE];
+};
+
+#define NEPITEM 64  // fds per epoll instance
+
+// An fd in an epoll interest set, keyed by (file, fd) as in
+// Linux. It holds no reference to the file: the file's last
+// fileclose() removes it, so a watched pipe end still closes.
+struct epitem {
+  struct file *file;       // 0 if slot is free
+  int fd;
+  struct epitem *fnext;    // next item watching file
+  uint events;             // events of interest, plus EPOLLET
+  int data;
+  struct pollent ent;      // queued on the file's waitq
+  int ready;               // on the ready list?
+  struct epitem *rnext;
+  struct eventpoll *ep;
+};
+
+// Everything but ctllock is protected by polllock.
+struct eventpoll {
+  struct sleeplock ctllock;  // serializes epoll_ctl()
+  int nwait;                 // epoll_wait() callers asleep on ep
+  struct epitem *rhead;      // ready list
+  struct epitem *rtail;
+  struct waitq wq;           // poll() callers watching ep
+  struct epitem item[NEPITEM];
+};
+
+void
+pollinit(void)
+{
+  initlock(&polllock, "poll");
+}
+
+// Put pe on wq. The caller must hold the lock of the object
+// that owns wq, so that a change made to the object after its
+// state was sampled is sure to call pe->wake.
+// A null pe just samples the state.
+void
+pollregister(struct waitq *wq, struct pollent *pe)
+{
+  if(pe == 0)
+    return;
+  acquire(&polllock);
+  pe->wq = wq;
+  pe->next = wq->head;
+  wq->head = pe;
+  release(&polllock);
+}
+
+// Take pe off its queue, if it is on one.
+// Caller must hold polllock.
+static void
+waitqremove(struct pollent *pe)
+{
+  struct pollent **pp;
+
+  if(pe->wq == 0)
+    return;
+  for(pp = &pe->wq->head; *pp; pp = &(*pp)->next){
+    if(*pp == pe){
+      *pp = pe->next;
+      break;
+    }
+  }
+  pe->wq = 0;
+}
+
+// Call every entry queued on wq with the events that may
+// have changed.
+// Caller must hold polllock.
+static void
+waitqwake1(struct waitq *wq, uint events)
+{
+  struct pollent *e;
+
+  for(e = wq->head; e; e = e->next)
+    e->wake(e, events);
+}
+
+void
+waitqwake(struct waitq *wq, uint events)
+{
+  acquire(&polllock);
+  waitqwake1(wq, events);
+  release(&polllock);
+}
+
+// poll() looks at every fd again anyway.
+static void
+pollsetwake(struct pollent *pe, uint events)
+{
+  struct pollset *ps = pe->arg;
+
+  ps->woken = 1;
+  wakeup(ps);
+}
+
+// Wait until one of the nfds files in fds is ready for the
+// events asked for, or until timeout ticks have passed
+// (forever if timeout is negative, not at all if it is 0).
+// Fills in each revents and returns the number of fds with
+// events, or -1 if the process was killed.
+int
+pollfds(struct pollfd *fds, int nfds, int timeout)
+{
+  struct pollset ps;
+  struct pollent *pe;
+  struct file *f;
+  uint start;
+  int i, n, fd;
+
+  if(nfds > NELEM(ps.ent))
+    return -1;
+  start = ticks;
+  for(;;){
+    ps.woken = 0;
+    n = 0;
+    for(i = 0; i < nfds; i++){
+      pe = &ps.ent[i];
+      pe->wq = 0;
+      pe->wake = pollsetwake;
+      pe->arg = &ps;
+      fds[i].revents = 0;
+      if((fd = fds[i].fd) < 0)
+        continue;
+      if(fd >= NOFILE || (f = myproc()->ofile[fd]) == 0)
+        fds[i].revents = POLLNVAL;
+      else
+        fds[i].revents = filepoll(f, pe) &
+          (fds[i].events | POLLERR | POLLHUP);
+      if(fds[i].revents)
+        n++;
+    }
+
+    acquire(&polllock);
+    if(n == 0 && timeout != 0 && !ps.woken && !myproc()->killed){
+      // Without a timeout only a wakeup can end the wait;
+      // otherwise wake on every tick to watch the clock.
+      if(timeout < 0)
+        sleep(&ps, &polllock);
+      else if(ticks - start < timeout)
+        sleep(&ticks, &polllock);
+    }
+    for(i = 0; i < nfds; i++)
+      waitqremove(&ps.ent[i]);
+    release(&polllock);
+
+    if(n > 0 || timeout == 0)
+      return n;
+    if(myproc()->killed)
+      return -1;
+    if(timeout > 0 && ticks - start >= timeout)
+      return 0;
+  }
+}
+
+//PAGEBREAK!
+// epoll
+
+struct eventpoll*
+epollalloc(void)
+{
+  struct eventpoll *ep;
+
+  if((ep = (struct eventpoll*)kalloc()) == 0)
+    return 0;
+  memset(ep, 0, sizeof(*ep));
+  initsleeplock(&ep->ctllock, "epoll");
+  return ep;
+}
+
+// Append it to the ready list unless it is already there,
+// and wake anyone waiting on the instance.
+// Caller must hold polllock.
+static void
+epready(struct epitem *it)
+{
+  struct eventpoll *ep = it->ep;
+
+  if(!it->ready){
+    it->ready = 1;
+    it->rnext = 0;
+    if(ep->rtail)
+      ep->rtail->rnext = it;
+    else
+      ep->rhead = it;
+    ep->rtail = it;
+  }
+  if(ep->nwait)
+    wakeup(ep);
+  waitqwake1(&ep->wq, POLLIN);
+}
+
+// Only events the item watches re-arm it: a read that drains
+// part of a pipe must not report an EPOLLIN|EPOLLET item again.
+static void
+epwake(struct pollent *pe, uint events)
+{
+  struct epitem *it = pe->arg;
+
+  if(events & (it->events | POLLERR | POLLHUP))
+    epready(it);
+}
+
+// Take it off the ready list.
+// Caller must hold polllock.
+static void
+epunready(struct epitem *it)
+{
+  struct eventpoll *ep = it->ep;
+  struct epitem **pp, *prev;
+
+  if(!it->ready)
+    return;
+  prev = 0;
+  for(pp = &ep->rhead; *pp != it; pp = &(*pp)->rnext)
+    prev = *pp;
+  *pp = it->rnext;
+  if(ep->rtail == it)
+    ep->rtail = prev;
+  it->ready = 0;
+}
+
+static struct epitem*
+eplookup(struct eventpoll *ep, int fd, struct file *f)
+{
+  struct epitem *it;
+
+  for(it = ep->item; it < &ep->item[NEPITEM]; it++)
+    if(it->file == f && it->fd == fd)
+      return it;
+  return 0;
+}
+
+// Stop watching: take it off its waitq, the ready list and
+// its file's item list, and free the slot.
+// Caller must hold polllock.
+static void
+epremove(struct epitem *it)
+{
+  struct epitem **pp;
+
+  waitqremove(&it->ent);
+  epunready(it);
+  for(pp = &it->file->epitems; *pp; pp = &(*pp)->fnext){
+    if(*pp == it){
+      *pp = it->fnext;
+      break;
+    }
+  }
+  it->file = 0;
+}
+
+// Called by fileclose() when the last reference to f is about
+// to go: remove f from every epoll instance watching it.
+void
+epolldetach(struct file *f)
+{
+  acquire(&polllock);
+  while(f->epitems)
+    epremove(f->epitems);
+  release(&polllock);
+}
+
+// Add, change or remove the interest in file f, open as fd.
+int
+epollctl(struct eventpoll *ep, int op, int fd, struct file *f,
+         struct epoll_event *ev)
+{
+  struct epitem *it;
+  int mask;
+
+  if(f->type == FD_EPOLL)
+    return -1;
+  acquiresleep(&ep->ctllock);
+  acquire(&polllock);
+  it = eplookup(ep, fd, f);
+  switch(op){
+  case EPOLL_CTL_ADD:
+    if(it != 0)
+      goto bad;
+    for(it = ep->item; it < &ep->item[NEPITEM] && it->file; it++)
+      ;
+    if(it == &ep->item[NEPITEM])
+      goto bad;
+    it->file = f;
+    it->fd = fd;
+    it->fnext = f->epitems;
+    f->epitems = it;
+    it->events = ev->events;
+    it->data = ev->data;
+    it->ready = 0;
+    it->ep = ep;
+    it->ent.wq = 0;
+    it->ent.wake = epwake;
+    it->ent.arg = it;
+    release(&polllock);
+    mask = filepoll(f, &it->ent);
+    break;
+  case EPOLL_CTL_MOD:
+    if(it == 0)
+      goto bad;
+    it->events = ev->events;
+    it->data = ev->data;
+    release(&polllock);
+    mask = filepoll(f, 0);
+    break;
+  case EPOLL_CTL_DEL:
+    if(it == 0)
+      goto bad;
+    epremove(it);
+    release(&polllock);
+    releasesleep(&ep->ctllock);
+    return 0;
+  default:
+    goto bad;
+  }
+
+  // Queue the item now if it is already ready.
+  acquire(&polllock);
+  if(mask & (it->events | POLLERR | POLLHUP))
+    epready(it);
+  release(&polllock);
+  releasesleep(&ep->ctllock);
+  return 0;
+
+bad:
+  release(&polllock);
+  releasesleep(&ep->ctllock);
+  return -1;
+}
+
+// Wait for ready items as pollfds() does and return up to
+// maxevents of them in evs. Only items on the ready list are
+// examined. Level-triggered items that are still ready go
+// back on the list for the next call; EPOLLET items wait for
+// their next wakeup.
+int
+epollwait(struct eventpoll *ep, struct epoll_event *evs, int maxevents,
+          int timeout)
+{
+  struct epitem *it[NEPITEM];
+  struct file *f[NEPITEM];
+  int mask[NEPITEM];
+  uint start;
+  int i, n, nout;
+
+  if(maxevents <= 0)
+    return -1;
+  if(maxevents > NEPITEM)
+    maxevents = NEPITEM;
+  start = ticks;
+  for(;;){
+    acquire(&polllock);
+    while(ep->rhead == 0){
+      if(myproc()->killed){
+        release(&polllock);
+        return -1;
+      }
+      if(timeout == 0 || (timeout > 0 && ticks - start >= timeout)){
+        release(&polllock);
+        return 0;
+      }
+      ep->nwait++;
+      sleep(timeout < 0 ? (void*)ep : (void*)&ticks, &polllock);
+      ep->nwait--;
+    }
+    for(n = 0; n < maxevents && ep->rhead; n++){
+      it[n] = ep->rhead;
+      ep->rhead = it[n]->rnext;
+      if(ep->rhead == 0)
+        ep->rtail = 0;
+      it[n]->ready = 0;
+      f[n] = filedup(it[n]->file);
+    }
+    release(&polllock);
+
+    // filepoll() takes the object's lock, which must not be
+    // taken while holding polllock; the references keep the
+    // files alive meanwhile.
+    for(i = 0; i < n; i++)
+      mask[i] = filepoll(f[i], 0);
+
+    acquire(&polllock);
+    nout = 0;
+    for(i = 0; i < n; i++){
+      if(it[i]->file != f[i])  // removed meanwhile
+        continue;
+      mask[i] &= it[i]->events | POLLERR | POLLHUP;
+      if(mask[i] == 0)
+        continue;
+      evs[nout].events = mask[i];
+      evs[nout].data = it[i]->data;
+      nout++;
+      if(!(it[i]->events & EPOLLET))
+        epready(it[i]);
+    }
+    release(&polllock);
+    for(i = 0; i < n; i++)
+      fileclose(f[i]);
+    if(nout > 0)
+      return nout;
+  }
+}
+
+// An epoll instance is readable when its ready list is not
+// empty.
+int
+epollpoll(struct eventpoll *ep, struct pollent *pe)
+{
+  int mask;
+
+  pollregister(&ep->wq, pe);
+  acquire(&polllock);
+  mask = ep->rhead ? POLLIN : 0;
+  release(&polllock);
+  return mask;
+}
+
+// Called when the last reference to the epoll file goes away.
+void
+epollclose(struct eventpoll *ep)
+{
+  struct epitem *it;
+
+  acquire(&polllock);
+  for(it = ep->item; it < &ep->item[NEPITEM]; it++)
+    if(it->file)
+      epremove(it);
+  release(&polllock);
+  freesleeplock(&ep->ctllock);
+  kfree((char*)ep);
+}
@@ -0,0 +1,29 @@
+// poll() events
+#define POLLIN   0x001  // data to read
+#define POLLOUT  0x004  // room to write
+#define POLLERR  0x008  // write end of a pipe with no reader
+#define POLLHUP  0x010  // read end of a pipe with no writer
+#define POLLNVAL 0x020  // fd is not open
+
+struct pollfd {
+  int fd;         // file descriptor to watch
+  short events;   // events the caller is interested in
+  short revents;  // events that occurred
+};
+
+// epoll events are the poll() events plus these flags.
+#define EPOLLIN   POLLIN
+#define EPOLLOUT  POLLOUT
+#define EPOLLERR  POLLERR
+#define EPOLLHUP  POLLHUP
+#define EPOLLET   0x100  // edge-triggered: report once per wakeup
+
+// epoll_ctl() operations
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+struct epoll_event {
+  uint events;    // events of interest / events that occurred
+  int data;       // returned as is by epoll_wait()
+};
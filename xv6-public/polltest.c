@@ -0,0 +1,129 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "poll.h"
+#include "fcntl.h"
+
+#define NPIPE 4
+
+char buf[2*4096];
+
+int
+nonblocktest(void)
+{
+  int p[2], n;
+
+  if(pipe(p) < 0){
+    printf(1, "pipe failed\n");
+    return -1;
+  }
+  if(fcntl(p[0], F_SETFL, O_NONBLOCK) < 0 || fcntl(p[1], F_SETFL, O_NONBLOCK) < 0 ||
+     fcntl(p[0], F_GETFL, 0) != O_NONBLOCK){
+    printf(1, "F_SETFL failed\n");
+    return -1;
+  }
+  if(read(p[0], buf, 1) != EWOULDBLOCK){
+    printf(1, "read of empty pipe did not return EWOULDBLOCK\n");
+    return -1;
+  }
+  n = fcntl(p[1], F_GETPIPE_SZ, 0);
+  if(write(p[1], buf, sizeof(buf)) != n){
+    printf(1, "write to small pipe was not short\n");
+    return -1;
+  }
+  if(write(p[1], buf, 1) != EWOULDBLOCK){
+    printf(1, "write to full pipe did not return EWOULDBLOCK\n");
+    return -1;
+  }
+  close(p[1]);
+  if(read(p[0], buf, sizeof(buf)) != n || read(p[0], buf, 1) != 0){
+    printf(1, "read after close failed\n");
+    return -1;
+  }
+  close(p[0]);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fds[NPIPE][2], i, n, got, pid, start;
+  struct pollfd pfd[NPIPE];
+  char c;
+
+  printf(1, "polltest starting\n");
+  for(i = 0; i < NPIPE; i++){
+    if(pipe(fds[i]) < 0){
+      printf(1, "pipe failed\n");
+      exit();
+    }
+  }
+
+  printf(1, "1. timeout test\n");
+  pfd[0].fd = fds[0][0];
+  pfd[0].events = POLLIN;
+  start = uptime();
+  if(poll(pfd, 1, 5) != 0 || uptime() - start < 5){
+    printf(1, "poll on empty pipe did not time out\n");
+    exit();
+  }
+  pfd[0].fd = fds[0][1];
+  pfd[0].events = POLLOUT;
+  if(poll(pfd, 1, -1) != 1 || pfd[0].revents != POLLOUT){
+    printf(1, "empty pipe not writable\n");
+    exit();
+  }
+
+  printf(1, "2. wait test\n");
+  // Child i writes its number to pipe i after (NPIPE-i)*10 ticks,
+  // so the pipes become readable in reverse order.
+  for(i = 0; i < NPIPE; i++){
+    if((pid = fork()) < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      sleep((NPIPE - i) * 10);
+      c = '0' + i;
+      write(fds[i][1], &c, 1);
+      exit();
+    }
+  }
+  for(i = 0; i < NPIPE; i++){
+    close(fds[i][1]);
+    pfd[i].fd = fds[i][0];
+    pfd[i].events = POLLIN;
+  }
+  got = 0;
+  while(got < NPIPE){
+    if((n = poll(pfd, NPIPE, -1)) <= 0){
+      printf(1, "poll failed\n");
+      exit();
+    }
+    for(i = 0; i < NPIPE; i++){
+      if(pfd[i].revents & POLLIN){
+        if(read(pfd[i].fd, &c, 1) != 1 || c != '0' + i){
+          printf(1, "bad data on pipe %d\n", i);
+          exit();
+        }
+        if(NPIPE - 1 - i != got){
+          printf(1, "pipe %d ready out of order\n", i);
+          exit();
+        }
+        got++;
+      }
+      if(pfd[i].revents & POLLHUP){
+        close(pfd[i].fd);
+        pfd[i].fd = -1;
+      }
+    }
+  }
+  for(i = 0; i < NPIPE; i++)
+    wait();
+
+  printf(1, "3. non-blocking test\n");
+  if(nonblocktest() < 0)
+    exit();
+  printf(1, "polltest ok\n");
+  exit();
+}
@@ -6,6 +6,7 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "rcu.h"
 
 struct {
   struct spinlock lock;
@@ -113,6 +114,13 @@ found:
   p->num_of_threads = 0;
   p->sum_of_threads = 0;
   p->retval = 0;
+  p->ustack = 0;
+  p->nstackfree = 0;
+  p->tlsbase = 0;
+  p->affinity = 0;
+  p->gang = 0;
+
+  p->ioring = 0;
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
@@ -158,6 +166,7 @@ userinit(void)
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
   p->tf->es = p->tf->ds;
   p->tf->ss = p->tf->ds;
+  p->tf->gs = (SEG_UTLS << 3) | DPL_USER;  // inherited by every process
   p->tf->eflags = FL_IF;
   p->tf->esp = PGSIZE;
   p->tf->eip = 0;  // beginning of initcode.S
@@ -212,6 +221,7 @@ growproc(int n)
     } else if(n < 0){
       if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
         return -1;
+      uvmchanged(curproc);
     }
     curproc->sz = sz;
   }
@@ -224,6 +234,7 @@ growproc(int n)
     } else if(n < 0){
       if((sz = deallocuvm(curproc->parent->pgdir, sz, sz + n)) == 0)
         return -1;
+      uvmchanged(curproc);
     }
     curproc->parent->sz = sz;
   }
@@ -257,6 +268,8 @@ fork(void)
   np->sz = curproc->sz;
   np->parent = curproc;
   *np->tf = *curproc->tf;
+  np->tlsbase = curproc->tlsbase;
+  np->affinity = curproc->affinity;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
@@ -350,7 +363,9 @@ exitProcAndLWP(struct proc *curproc){
       // which means it does not use CPU no more.
       if(p->parent->num_of_threads == 0){
         p->parent->sz = deallocuvm(p->parent->pgdir, p->parent->sz, p->parent->sz - 2 * (p->parent->sum_of_threads) * PGSIZE);
+        uvmchanged(p->parent);
         p->parent->sum_of_threads = 0;
+        p->parent->nstackfree = 0;
       }
 
       kfree(p->kstack);
@@ -468,7 +483,9 @@ exitLWPAndLWP(struct proc *curproc){
   // which means it does not use CPU no more.
   if(curproc->parent->num_of_threads == 0 && curproc->parent->sum_of_threads > 0){
     curproc->parent->sz=deallocuvm(curproc->parent->pgdir, curproc->parent->sz, curproc->parent->sz - 2 * (curproc->parent->sum_of_threads - 1) * PGSIZE);
+    uvmchanged(curproc->parent);
     curproc->parent->sum_of_threads = 0;
+    curproc->parent->nstackfree = 0;
   }
 
   curproc->state = ZOMBIE;
@@ -548,7 +565,7 @@ wait(void)
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
-        freevm(p->pgdir);
+        freepgdir(p->pgdir);
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
@@ -588,6 +605,76 @@ wait(void)
   }
 }
 
+// The scheduler leaves the last page table it used loaded
+// (see switchuvmsched), so a page table being freed may still
+// be in some CPU's CR3. Such page tables wait here until that
+// CPU's scheduler moves off them. Protected by ptable.lock.
+static pde_t *deadpgdir[NPROC];
+static int ndeadpgdir;
+
+// Is pgdir loaded on another CPU? Unloads it from this one.
+// Caller must hold ptable.lock, which keeps schedulers from
+// loading page tables meanwhile.
+static int
+pgdirinuse(pde_t *pgdir)
+{
+  struct cpu *c, *me;
+  int inuse;
+
+  me = mycpu();
+  inuse = 0;
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(c->pgdir != pgdir)
+      continue;
+    if(c == me){
+      switchkvm();
+      c->pgdir = 0;
+    } else
+      inuse = 1;
+  }
+  return inuse;
+}
+
+// Free pgdir now, or once no CPU has it loaded.
+// Caller must hold ptable.lock.
+void
+freepgdir(pde_t *pgdir)
+{
+  int i;
+
+  if(!pgdirinuse(pgdir)){
+    freevm(pgdir);
+    return;
+  }
+  for(i = 0; i < NPROC; i++){
+    if(deadpgdir[i] == 0){
+      deadpgdir[i] = pgdir;
+      ndeadpgdir++;
+      return;
+    }
+  }
+  panic("freepgdir");
+}
+
+// Free the deferred page tables no CPU has loaded any more,
+// dropping this CPU's if it is one of them.
+// Caller must hold ptable.lock.
+static void
+reappgdirs(void)
+{
+  int i;
+
+  if(ndeadpgdir == 0)
+    return;
+  for(i = 0; i < NPROC; i++){
+    if(deadpgdir[i] && !pgdirinuse(deadpgdir[i])){
+      freevm(deadpgdir[i]);
+      deadpgdir[i] = 0;
+      ndeadpgdir--;
+    }
+  }
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -596,6 +683,51 @@ wait(void)
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
+
+// May p run on CPU c?
+static int
+cpuok(struct proc *p, struct cpu *c)
+{
+  return p->affinity == 0 || (p->affinity & (1 << (c - cpus)));
+}
+
+// Gang scheduling: if another CPU is running a thread in gang
+// mode, find a runnable sibling (same pgdir) to run alongside it,
+// so that a thread holding a user lock isn't left waiting on a
+// sibling that isn't running. Only a sibling the stride or MLFQ
+// scheduler would have picked anyway qualifies: gang mode chooses
+// among equals, it doesn't take other processes' shares.
+// stridep is the stride process with the lowest pass, or 0.
+// Caller must hold ptable.lock.
+static struct proc*
+gangpick(struct cpu *c, struct proc *stridep)
+{
+  struct cpu *o;
+  struct proc *p, *q;
+  int strideturn, level;
+
+  // Mirror the choice scheduler() is about to make.
+  strideturn = stridep != 0 && stridep->pass <= mlfq.pass;
+  level = 3;
+  if(!strideturn)
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+      if(p->state == RUNNABLE && !p->isStride && cpuok(p, c) && p->level < level)
+        level = p->level;
+
+  for(o = cpus; o < cpus+ncpu; o++){
+    if(o == c || (q = o->proc) == 0 || !q->gang)
+      continue;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p->state != RUNNABLE || p->pgdir != q->pgdir || !cpuok(p, c))
+        continue;
+      if(strideturn ? p->isStride && p->pass <= stridep->pass :
+                      !p->isStride && p->level == level)
+        return p;
+    }
+  }
+  return 0;
+}
+
 void
 scheduler(void)
 {
@@ -613,8 +745,11 @@ scheduler(void)
     int lowest_pass = 987654321;
     struct proc *selectedproc = 0;
     acquire(&ptable.lock);
+    rcu_qs();
+    reappgdirs();
+
     for(p=ptable.proc; p<&ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
+      if(p->state != RUNNABLE || !cpuok(p, c))
         continue;
       if(p->isStride == FALSE)
         continue;
@@ -624,6 +759,29 @@ scheduler(void)
       }
     }
 
+    if((p = gangpick(c, selectedproc)) != 0){
+      // Charge it as its own scheduler would.
+      if(p->isStride)
+        p->pass += p->stride;
+      else {
+        mlfq.pass += mlfq.stride;
+        p->ticks += time_quantum[p->level];
+      }
+      c->proc = p;
+      switchuvmsched(p);
+      p->state = RUNNING;
+
+      swtch(&(c->scheduler), p->context);
+
+      if(!p->isStride && p->ticks >= time_allotment[p->level]){
+        p->ticks = 0;
+        p->level = p->level == 2 ? 0 : p->level + 1;
+      }
+      c->proc = 0;
+      release(&ptable.lock);
+      continue;
+    }
+
     // If there is no process in Stride scheduler,
     // or the process which has the minimum pass value is mlfq,
     // one more MLFQ scheduling is needed.
@@ -642,18 +800,17 @@ scheduler(void)
       // level 0 (highest level)
       int found = FALSE;
       for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-        if(p->state != RUNNABLE || p->isStride || p->level != 0) {
+        if(p->state != RUNNABLE || p->isStride || p->level != 0 || !cpuok(p, c)) {
           continue;
         }
 
         found = TRUE;
         c->proc = p;
         p->ticks += time_quantum[p->level];
-        switchuvm(p);
+        switchuvmsched(p);
         p->state = RUNNING;
 
         swtch(&(c->scheduler), p->context);
-        switchkvm();
 
         if(p->ticks >= time_allotment[p->level]){
           p->ticks = 0;
@@ -664,17 +821,16 @@ scheduler(void)
       // level 1 (middle level)
       if(!found){
         for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-          if(p->state != RUNNABLE || p->isStride || p->level != 1)
+          if(p->state != RUNNABLE || p->isStride || p->level != 1 || !cpuok(p, c))
             continue;
 
           found = TRUE;
           c->proc = p;
           p->ticks += time_quantum[p->level];
-          switchuvm(p);
+          switchuvmsched(p);
           p->state = RUNNING;
 
           swtch(&(c->scheduler), p->context);
-          switchkvm();
 
           if(p->ticks >= time_allotment[p->level]){
             p->ticks = 0;
@@ -687,17 +843,16 @@ scheduler(void)
       // level 2 (lowest level)
       if(!found){
         for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-          if(p->state != RUNNABLE || p->isStride || p->level != 2)
+          if(p->state != RUNNABLE || p->isStride || p->level != 2 || !cpuok(p, c))
             continue;
 
           found = TRUE;
           c->proc = p;
           p->ticks += time_quantum[p->level];
-          switchuvm(p);
+          switchuvmsched(p);
           p->state = RUNNING;
 
           swtch(&(c->scheduler), p->context);
-          switchkvm();
 
           // Priority Boost
           if(p->ticks >= time_allotment[p->level]){
@@ -711,7 +866,7 @@ scheduler(void)
     else{
       //cprintf("STride!!!!!\n");
       c->proc = selectedproc;
-      switchuvm(selectedproc);
+      switchuvmsched(selectedproc);
       selectedproc->state = RUNNING;
       selectedproc->pass += selectedproc->stride;
 
@@ -719,7 +874,6 @@ scheduler(void)
       // to release ptable.lock and then reacquire it
       // before jumping back to us.
       swtch(&(c->scheduler), selectedproc->context);
-      switchkvm();
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
@@ -776,6 +930,7 @@ sched(void)
     panic("sched running");
   if(readeflags()&FL_IF)
     panic("sched interruptible");
+  rcu_qs();
   intena = mycpu()->intena;
   swtch(&p->context, mycpu()->scheduler);
   mycpu()->intena = intena;
@@ -882,19 +1037,29 @@ kill(int pid)
 {
   struct proc *p;
 
+  // Find the process without ptable.lock. The proc structures
+  // are never freed, only reused, so a reader can't be left
+  // pointing at freed memory; recheck the pid under the lock
+  // in case the slot was reused meanwhile.
+  rcu_read_lock();
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(rcu_deref(p->pid) == pid)
+      break;
+  rcu_read_unlock();
+  if(p == &ptable.proc[NPROC])
+    return -1;
+
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
-    }
+  if(p->pid != pid){
+    release(&ptable.lock);
+    return -1;
   }
+  p->killed = 1;
+  // Wake process from sleep if necessary.
+  if(p->state == SLEEPING)
+    p->state = RUNNABLE;
   release(&ptable.lock);
-  return -1;
+  return 0;
 }
 
 
@@ -1018,7 +1183,7 @@ int
 thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg){
   int i;
   struct proc *np, *curproc, *p;
-  uint sp, args[2];
+  uint sp, base, sz, args[2];
 
   curproc = myproc();
 
@@ -1029,12 +1194,29 @@ thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg){
 
   acquire(&processlock);
 
-  curproc->sz = PGROUNDUP(curproc->sz);
-  if((curproc->sz = allocuvm(curproc->pgdir, curproc->sz, curproc->sz + 2 * PGSIZE)) == 0){
-    return -1;
+  // Each thread stack is a two-page slot: a guard page, which
+  // clearpteu() makes inaccessible so an overflow faults, and
+  // the stack itself. Reuse the slot of a joined thread if there
+  // is one, so creating threads in a loop doesn't keep growing
+  // the address space.
+  if(curproc->nstackfree > 0)
+    base = curproc->stackfree[--curproc->nstackfree];
+  else {
+    base = PGROUNDUP(curproc->sz);
+    if((sz = allocuvm(curproc->pgdir, base, base + 2 * PGSIZE)) == 0){
+      release(&processlock);
+      kfree(np->kstack);
+      np->kstack = 0;
+      np->state = UNUSED;
+      return -1;
+    }
+    clearpteu(curproc->pgdir, (char*)base);
+    uvmchanged(curproc);
+    curproc->sz = sz;
+    curproc->sum_of_threads++;
   }
 
-  sp = curproc->sz;
+  sp = base + 2 * PGSIZE;
 
   // Shallow copy pgdir and add thread information.
   np->pgdir = curproc->pgdir;   // same address space
@@ -1042,24 +1224,31 @@ thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg){
   np->parent = curproc;
   *np->tf = *curproc->tf;
   np->tid = (thread_t)np->pid;
+  np->ustack = base;
+  np->affinity = curproc->affinity;
+  np->gang = curproc->gang;
   
   // Set return value thread
   *thread = np->tid;
 
   // Update the caller process.
   np->parent->num_of_threads++;
-  np->parent->sum_of_threads++;
   release(&processlock);
 
+  // The thread's TLS block sits at the top of its stack.
+  sp -= TLSSIZE;
+  np->tlsbase = sp;
+  if(inittls(np->pgdir, np->tlsbase) < 0)
+    goto bad;
+
   args[0] = 0xDEADDEAD; // fake return address
   args[1] = (uint)arg;
 
   sp -= 8;
 
   // Thread function arguments
-  if(copyout(np->pgdir, sp, args, (2)*4) < 0){
-    return -1;
-  }
+  if(copyout(np->pgdir, sp, args, (2)*4) < 0)
+    goto bad;
 
   // Clear %eax so that thread_create returns 0 in the child.
   np->tf->eax = 0;
@@ -1068,7 +1257,7 @@ thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg){
   np->tf->eip = (uint)start_routine;
 
   // Set esp to current stack pointer.
-  np->tf->esp = np->sz - 8;
+  np->tf->esp = sp;
 
   // Copy opened files from parent process.
   for(i = 0; i < NOFILE; i++)
@@ -1109,6 +1298,20 @@ thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg){
   release(&ptable.lock);
 
   return 0;
+
+bad:
+  // Give back the stack slot and the thread count, and free
+  // np as fork() does when it can't copy the address space.
+  acquire(&processlock);
+  curproc->stackfree[curproc->nstackfree++] = base;
+  curproc->num_of_threads--;
+  release(&processlock);
+  kfree(np->kstack);
+  np->kstack = 0;
+  np->parent = 0;
+  np->tid = 0;
+  np->state = UNUSED;
+  return -1;
 }
 
 // Almost same as the original exit function,
@@ -1183,16 +1386,10 @@ thread_join(thread_t thread, void **retval){
       if(p->state == ZOMBIE){
         p->parent->num_of_threads--;
 
-        // If the number of threads of parent process is 0,
-        // reduce the momory size and set the total share of threads 0
-        // which means it does not use CPU no more.
-        if(p->parent->num_of_threads == 0){
-          if((p->parent->sz = 
-                deallocuvm(p->parent->pgdir, p->parent->sz, 
-                  p->parent->sz - 2 * (p->parent->sum_of_threads) * PGSIZE)) == 0)
-            return -1;
-          p->parent->sum_of_threads = 0;
-        }
+        // Keep the thread's stack slot for the next thread_create(),
+        // rather than shrinking the address space.
+        p->parent->stackfree[p->parent->nstackfree++] = p->ustack;
+        p->ustack = 0;
 
         ret = p->pid;
         *retval = p->retval;
@@ -1231,3 +1428,109 @@ thread_join(thread_t thread, void **retval){
     sleep(curproc, &ptable.lock);   //DOC: wait-sleep
   }
 }
+
+// Futexes: a thread sleeps on a user address until another
+// thread sharing its address space wakes it. The address is
+// the sleep channel; user addresses lie below KERNBASE, so
+// they can't collide with kernel channels, and the pgdir
+// keeps unrelated processes' addresses apart.
+
+// Sleep on addr if the int there still holds val. Checking
+// the value under ptable.lock means a futexwake() issued after
+// the waker changed it can't be missed. Returns 0 when woken
+// (possibly spuriously), -1 if *addr != val or addr is bad.
+int
+futexwait(uint addr, int val)
+{
+  struct proc *curproc = myproc();
+  uint sz;
+
+  // A thread's own sz is a stale copy; the address space's
+  // size is kept in the main thread, as growproc() does.
+  sz = curproc->tid ? curproc->parent->sz : curproc->sz;
+  if(addr == 0 || addr % 4 || addr >= sz || addr+4 > sz)
+    return -1;
+  acquire(&ptable.lock);
+  if(*(int*)addr != val){
+    release(&ptable.lock);
+    return -1;
+  }
+  sleep((void*)addr, &ptable.lock);
+  release(&ptable.lock);
+  return 0;
+}
+
+// Wake up to n threads sleeping on addr in this address space.
+// Returns the number woken.
+int
+futexwake(uint addr, int n)
+{
+  struct proc *curproc = myproc();
+  struct proc *p;
+  int woken;
+
+  woken = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC] && woken < n; p++){
+    if(p->state == SLEEPING && p->chan == (void*)addr &&
+       p->pgdir == curproc->pgdir){
+      p->state = RUNNABLE;
+      woken++;
+    }
+  }
+  release(&ptable.lock);
+  return woken;
+}
+
+// Restrict thread or process pid (0: the caller) to the CPUs
+// whose bits are set in mask.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *curproc = myproc();
+  struct proc *p;
+  int ok;
+
+  if(ncpu < 32)
+    mask &= (1 << ncpu) - 1;
+  if(mask == 0)
+    return -1;
+  if(pid == 0)
+    pid = curproc->pid;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid == pid && p->state != UNUSED){
+      p->affinity = mask;
+      release(&ptable.lock);
+      // Move off this CPU if we may no longer use it;
+      // this CPU's scheduler won't pick us again.
+      if(p == curproc){
+        pushcli();
+        ok = cpuok(p, mycpu());
+        popcli();
+        if(!ok)
+          yield();
+      }
+      return 0;
+    }
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Turn gang scheduling on or off for the caller and every
+// thread sharing its address space. Threads created later
+// inherit the setting.
+int
+setgang(int on)
+{
+  struct proc *curproc = myproc();
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state != UNUSED && p->pgdir == curproc->pgdir)
+      p->gang = (on != 0);
+  release(&ptable.lock);
+  return 0;
+}
@@ -8,6 +8,10 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  pde_t *pgdir;                // User page table loaded, or null
+  uint vmgen;                  // Owner's vmgen when pgdir was loaded
+  int tssloaded;               // Has ltr loaded this cpu's TSS?
+  uint nreload;                // User page table loads, for cswbench
 };
 
 extern struct cpu cpus[NCPU];
@@ -65,8 +69,18 @@ struct proc {
 	                             // (tid == 0 && num_of_threads == 0) process
 															 // (tid == 0 && num_of_threads != 0) main thread
 															 // (tid != 0 && num_of_threads == 0) normal thread
-	int sum_of_threads;          // Total number of threads created.
+	int sum_of_threads;          // Thread stack slots allocated.
 	void *retval;                // Return value in thread.
+	uint ustack;                 // Thread: base of its stack slot
+	uint vmgen;                  // Mapping changes (main thread only; see uvmchanged)
+	uint tlsbase;                // Thread-local storage, addressed by %gs
+
+	uint affinity;               // CPUs it may run on, one bit each; 0: any
+	int gang;                    // Co-schedule with threads sharing pgdir?
+	uint stackfree[NPROC];       // Stack slots of joined threads, for reuse
+	int nstackfree;
+
+	struct io_ring *ioring;      // Ring registered by io_setup(), or 0
 
 };
 
@@ -14,6 +14,7 @@ int fd; // Shared among threads
 
 void pwritetest();
 void preadtest();
+void sparsetest();
 
 int
 main(int argc, char *argv[])
@@ -28,6 +29,11 @@ main(int argc, char *argv[])
   preadtest();
   printf(1, "Finished\n");
 
+  // sparse file test
+  printf(1, "3. Start sparse pwrite test\n");
+  sparsetest();
+  printf(1, "Finished\n");
+
   exit();
 }
 
@@ -143,3 +149,43 @@ preadtest()
   }
   close(fd);
 }
+
+// A pwrite far past the end of a new file should leave a hole
+// that reads back as zeros, and take about as long as a small
+// write rather than one proportional to the offset.
+void
+sparsetest()
+{
+  char *sparsepath = "sparsefile";
+  char buf[BUFSIZE];
+  struct stat st;
+  int i, start;
+
+  fd = open(sparsepath, O_CREATE | O_RDWR);
+  start = uptime();
+  if(pwrite(fd, "end", 3, FILESIZE) != 3){
+    printf(1, "sparse pwrite failed\n");
+    exit();
+  }
+  printf(1, "pwrite at offset %d took %d ticks\n", FILESIZE, uptime() - start);
+  if(fstat(fd, &st) < 0 || st.size != FILESIZE + 3){
+    printf(1, "wrong size after sparse pwrite\n");
+    exit();
+  }
+  if(pread(fd, buf, sizeof(buf), FILESIZE / 2) != sizeof(buf)){
+    printf(1, "pread of hole failed\n");
+    exit();
+  }
+  for(i = 0; i < BUFSIZE; i++){
+    if(buf[i] != 0){
+      printf(1, "hole is not zero-filled\n");
+      exit();
+    }
+  }
+  if(pread(fd, buf, 3, FILESIZE) != 3 || buf[0] != 'e' || buf[2] != 'd'){
+    printf(1, "data after hole is wrong\n");
+    exit();
+  }
+  close(fd);
+  unlink(sparsepath);
+}
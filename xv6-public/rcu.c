@@ -0,0 +1,123 @@
+// Read-copy update.
+//
+// A reader runs with interrupts off between rcu_read_lock() and
+// rcu_read_unlock(), so it can't be switched away from its CPU.
+// A CPU that reaches sched() or the top of the scheduler loop
+// is therefore outside any read-side critical section; that is
+// a quiescent state. A grace period ends once every CPU has
+// passed through a quiescent state since it began, after which
+// no reader can still hold a pointer it loaded before.
+//
+// Updaters unlink an object, note rcu_gpstart(), and reuse the
+// object only once rcu_gpdone() says that grace period is over,
+// or block in synchronize_rcu(). Grace periods are only run
+// while someone is waiting for one, so an idle RCU costs the
+// scheduler a couple of loads.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+
+struct {
+  struct spinlock lock;
+  uint done;    // Number of grace periods completed
+  uint want;    // Grace period some updater is waiting for
+  uint mask;    // CPUs quiescent in the current grace period
+} rcu;
+
+void
+rcuinit(void)
+{
+  initlock(&rcu.lock, "rcu");
+}
+
+void
+rcu_read_lock(void)
+{
+  pushcli();
+}
+
+void
+rcu_read_unlock(void)
+{
+  popcli();
+}
+
+// Bit mask of the CPUs that are running.
+static uint
+cpumask(void)
+{
+  uint m;
+  int i;
+
+  m = 0;
+  for(i = 0; i < ncpu; i++)
+    if(cpus[i].started)
+      m |= 1 << i;
+  return m;
+}
+
+// Note a quiescent state on this CPU.
+// Called with interrupts off from sched() and scheduler().
+void
+rcu_qs(void)
+{
+  uint bit;
+
+  bit = 1 << cpuid();
+  if((int)(rcu.want - rcu.done) <= 0 || (rcu.mask & bit))
+    return;
+  acquire(&rcu.lock);
+  if((int)(rcu.want - rcu.done) > 0){
+    rcu.mask |= bit;
+    if((rcu.mask & cpumask()) == cpumask()){
+      rcu.done++;
+      rcu.mask = 0;
+    }
+  }
+  release(&rcu.lock);
+}
+
+// Start waiting for a grace period. Returns a ticket for
+// rcu_gpdone(): once it is done, readers that might have seen
+// anything unlinked before this call have all finished.
+uint
+rcu_gpstart(void)
+{
+  uint t;
+
+  acquire(&rcu.lock);
+  // A grace period already under way may have counted some
+  // CPUs as quiescent before this call, so wait for the next.
+  if((int)(rcu.want - rcu.done) > 0)
+    t = rcu.done + 2;
+  else
+    t = rcu.done + 1;
+  if((int)(t - rcu.want) > 0)
+    rcu.want = t;
+  release(&rcu.lock);
+  return t;
+}
+
+int
+rcu_gpdone(uint t)
+{
+  return (int)(rcu.done - t) >= 0;
+}
+
+// Wait for a grace period to pass. The caller must not hold
+// any spinlock or be in a read-side critical section.
+void
+synchronize_rcu(void)
+{
+  uint t;
+
+  t = rcu_gpstart();
+  while(!rcu_gpdone(t))
+    yield();
+}
@@ -0,0 +1,14 @@
+// Read-copy update; see rcu.c.
+//
+// Readers bracket lock-free traversals with rcu_read_lock() and
+// rcu_read_unlock() and load shared pointers with rcu_deref().
+// Updaters, holding whatever lock serializes them, publish new
+// objects with rcu_assign(), which orders the object's
+// initialization before the pointer store.
+
+#define rcu_deref(p) (*(__typeof__(p) volatile *)&(p))
+
+#define rcu_assign(p, v) do { \
+  __sync_synchronize(); \
+  rcu_deref(p) = (v); \
+} while(0)
@@ -0,0 +1,138 @@
+// Torture test for the RCU-protected lookups: path lookups through
+// the directory name cache while other processes churn it, and
+// kill() racing with processes exiting and pids being reused.
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NWORKER 4
+#define NNAME   64   // names per worker; together more than the cache holds
+#define ROUNDS  2000
+#define NKILL   200
+
+char *dirpath = "rcutest.d";
+
+void
+fail(char *msg)
+{
+  printf(1, "rcutest: %s\n", msg);
+  exit();
+}
+
+// Name of worker w's i'th file: "w" w "_" i.
+void
+mkname(char *name, int w, int i)
+{
+  name[0] = 'w';
+  name[1] = '0' + w;
+  name[2] = '_';
+  name[3] = '0' + i / 10;
+  name[4] = '0' + i % 10;
+  name[5] = 0;
+}
+
+// Create name with its own name as contents.
+void
+create(char *name)
+{
+  int fd;
+
+  if((fd = open(name, O_CREATE | O_RDWR)) < 0)
+    fail("create failed");
+  if(write(fd, name, 6) != 6)
+    fail("write failed");
+  close(fd);
+}
+
+// Each worker owns its names, so it knows exactly which of them
+// exist; every lookup must agree, and every file must hold the
+// name it was found under.
+void
+worker(int w)
+{
+  char name[6], buf[6];
+  int exists[NNAME];
+  uint seed;
+  int r, i, fd;
+
+  seed = w * 7919 + 1;
+  for(i = 0; i < NNAME; i++){
+    mkname(name, w, i);
+    create(name);
+    exists[i] = 1;
+  }
+  for(r = 0; r < ROUNDS; r++){
+    seed = seed * 1103515245 + 12345;
+    i = (seed >> 16) % NNAME;
+    mkname(name, w, i);
+    fd = open(name, O_RDONLY);
+    if((fd >= 0) != exists[i])
+      fail(exists[i] ? "lookup missed a file" : "lookup found an unlinked file");
+    if(fd >= 0){
+      if(read(fd, buf, 6) != 6 || strcmp(buf, name) != 0)
+        fail("lookup returned the wrong file");
+      close(fd);
+    }
+    if((seed >> 8) % 4 == 0){
+      if(exists[i]){
+        if(unlink(name) < 0)
+          fail("unlink failed");
+      } else
+        create(name);
+      exists[i] = !exists[i];
+    }
+  }
+  for(i = 0; i < NNAME; i++){
+    mkname(name, w, i);
+    if(exists[i])
+      unlink(name);
+  }
+  exit();
+}
+
+// Kill short-lived children, and pids that are already gone.
+void
+killer(void)
+{
+  int i, pid;
+
+  for(i = 0; i < NKILL; i++){
+    if((pid = fork()) < 0)
+      fail("fork failed");
+    if(pid == 0){
+      sleep(1);
+      exit();
+    }
+    if(kill(pid) < 0)
+      fail("kill of live child failed");
+    wait();
+    if(kill(pid) == 0)
+      fail("kill of reaped child succeeded");
+  }
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int w;
+
+  printf(1, "rcutest starting\n");
+  if(mkdir(dirpath) < 0 || chdir(dirpath) < 0)
+    fail("mkdir failed");
+
+  for(w = 0; w < NWORKER; w++){
+    if(fork() == 0)
+      worker(w);
+  }
+  if(fork() == 0)
+    killer();
+  for(w = 0; w < NWORKER + 1; w++)
+    wait();
+
+  if(chdir("..") < 0 || unlink(dirpath) < 0)
+    fail("rm failed");
+  printf(1, "rcutest ok\n");
+  exit();
+}
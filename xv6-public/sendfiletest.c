@@ -0,0 +1,85 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+char *filepath = "sendfiletest.f";
+char *copypath = "sendfiletest.c2";
+char payload[6000];
+char buf[6000];
+
+int
+same(char *a, char *b, int n)
+{
+  while(n-- > 0)
+    if(*a++ != *b++)
+      return 0;
+  return 1;
+}
+
+void
+fail(char *msg)
+{
+  printf(1, "sendfiletest: %s\n", msg);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, out, p[2], i, n, size;
+
+  printf(1, "sendfiletest starting\n");
+  for(i = 0; i < sizeof(payload); i++)
+    payload[i] = 'a' + i % 26;
+  if((fd = open(filepath, O_CREATE | O_RDWR)) < 0)
+    fail("open failed");
+  if(write(fd, payload, sizeof(payload)) != sizeof(payload))
+    fail("write failed");
+  close(fd);
+
+  printf(1, "1. file to file test\n");
+  if((fd = open(filepath, O_RDONLY)) < 0 ||
+     (out = open(copypath, O_CREATE | O_RDWR)) < 0)
+    fail("open failed");
+  if(sendfile(out, fd, 100) != 100)
+    fail("sendfile of a prefix failed");
+  if(sendfile(out, fd, 1 << 20) != sizeof(payload) - 100)
+    fail("sendfile didn't stop at end of input");
+  if(sendfile(out, fd, 10) != 0)
+    fail("sendfile at end of input didn't return 0");
+  close(fd);
+  close(out);
+  if((fd = open(copypath, O_RDONLY)) < 0)
+    fail("open failed");
+  if(read(fd, buf, sizeof(buf)) != sizeof(payload) || !same(buf, payload, sizeof(payload)))
+    fail("copy has wrong contents");
+  close(fd);
+  unlink(copypath);
+
+  printf(1, "2. short write test\n");
+  // With 100 bytes already in the pipe and no reader, only
+  // size-100 more fit; sendfile must say so and leave the
+  // input just past them.
+  if(pipe(p) < 0)
+    fail("pipe failed");
+  if((size = fcntl(p[1], F_GETPIPE_SZ, 0)) <= 100 || size >= sizeof(payload))
+    fail("unexpected pipe size");
+  if(write(p[1], payload, 100) != 100)
+    fail("write to pipe failed");
+  close(p[0]);
+  if((fd = open(filepath, O_RDONLY)) < 0)
+    fail("open failed");
+  if((n = sendfile(p[1], fd, sizeof(payload))) != size - 100){
+    printf(1, "sendfile returned %d, want %d\n", n, size - 100);
+    fail("short write miscounted");
+  }
+  if(read(fd, buf, 10) != 10 || !same(buf, payload + n, 10))
+    fail("input offset not left after the bytes sent");
+  close(fd);
+  close(p[1]);
+  unlink(filepath);
+
+  printf(1, "sendfiletest ok\n");
+  exit();
+}
@@ -10,23 +10,68 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 
+// How many times acquiresleep() polls a lock whose owner is
+// running before giving up and sleeping.
+#define SLEEPSPIN 10000
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
+  lk->wwait = 0;
+  lk->owner = 0;
   lk->pid = 0;
 }
 
+// Call before freeing the memory holding lk.
+void
+freesleeplock(struct sleeplock *lk)
+{
+  freelock(&lk->lk);
+}
+
+// Is lk held exclusively by a process running on another CPU?
+// Reads owner->state without ptable.lock, so the answer is only
+// a hint; proc structures are never freed, so it is a safe one.
+static int
+ownerrunning(struct sleeplock *lk)
+{
+  struct proc *o;
+
+  o = *(struct proc * volatile *)&lk->owner;
+  return o != 0 && o != myproc() && o->state == RUNNING;
+}
+
+// Locks like buffer and inode locks are usually held only
+// briefly, so if the owner is running on another CPU, poll
+// for a while before paying for a sleep and a context switch.
+// A lock held shared has no single owner to watch, so waiters
+// for it always sleep.
 void
 acquiresleep(struct sleeplock *lk)
 {
+  int spins;
+
+  spins = 0;
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  while (lk->locked || lk->readers) {
+    lk->wwait++;
+    if(!lk->readers && spins < SLEEPSPIN && ownerrunning(lk)){
+      release(&lk->lk);
+      while(spins < SLEEPSPIN && *(volatile uint*)&lk->locked && ownerrunning(lk)){
+        pause();
+        spins++;
+      }
+      acquire(&lk->lk);
+    } else
+      sleep(lk, &lk->lk);
+    lk->wwait--;
   }
   lk->locked = 1;
+  lk->owner = myproc();
   lk->pid = myproc()->pid;
   release(&lk->lk);
 }
@@ -36,18 +81,57 @@ releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
   wakeup(lk);
   release(&lk->lk);
 }
 
+// Acquire lk in shared mode: any number of shared holders
+// may hold it at once, but not together with an exclusive
+// holder. Waiting exclusive acquirers go first, so a stream
+// of readers can't starve them.
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  while (lk->locked || lk->wwait) {
+    sleep(lk, &lk->lk);
+  }
+  lk->readers++;
+  release(&lk->lk);
+}
+
+void
+releasesleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->readers <= 0)
+    panic("releasesleepshared");
+  if(--lk->readers == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+int
+holdingsleepshared(struct sleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = lk->readers > 0;
+  release(&lk->lk);
+  return r;
+}
+
+// Does the current process hold lk exclusively?
 int
 holdingsleep(struct sleeplock *lk)
 {
   int r;
   
   acquire(&lk->lk);
-  r = lk->locked;
+  r = lk->locked && lk->pid == myproc()->pid;
   release(&lk->lk);
   return r;
 }
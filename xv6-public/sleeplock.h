@@ -1,8 +1,12 @@
 // Long-term locks for processes
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  int readers;       // Number of shared holders
+  int wwait;         // Exclusive acquirers waiting
   struct spinlock lk; // spinlock protecting this sleep lock
   
+  struct proc *owner; // Process holding lock exclusively
+
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
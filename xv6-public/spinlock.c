@@ -8,13 +8,187 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+// Every initialized lock is on locklist, so getlockstats() can
+// find its counters. statlocked protects the list. It is a bare
+// xchg lock rather than a spinlock because initlock() runs
+// before mpinit(), when acquire() can't yet call mycpu().
+static uint statlocked;
+static struct spinlock *locklist;
+
+static uint
+statlock(void)
+{
+  uint eflags;
+
+  eflags = readeflags();
+  cli();
+  while(xchg(&statlocked, 1) != 0)
+    pause();
+  return eflags;
+}
+
+static void
+statunlock(uint eflags)
+{
+  xchg(&statlocked, 0);
+  if(eflags & FL_IF)
+    sti();
+}
+
+// The lock profiler. Each CPU records into its own table, so
+// the (interrupts-off) holder of a lock can update it without
+// further locking. Tables are cleared lazily: LOCKPROF_RESET
+// bumps profgen and each CPU wipes its table when it next
+// records with a stale generation.
+struct profent {
+  char *name;
+  uint pc;
+  uint nacquire;
+  uint ncontend;
+  unsigned long long wait;
+  unsigned long long hold;
+};
+
+static struct {
+  uint gen;
+  struct profent ent[NLOCKPROF];
+} proftab[NCPU];
+
+static int profon;
+static uint profgen = 1;
+
+static void
+profrecord(struct spinlock *lk, uint held)
+{
+  struct profent *e;
+  uint pc, h, i;
+  int c;
+
+  c = lk->cpu - cpus;
+  if(proftab[c].gen != profgen){
+    memset(proftab[c].ent, 0, sizeof(proftab[c].ent));
+    proftab[c].gen = profgen;
+  }
+  pc = lk->pcs[0];
+  h = (pc ^ (uint)lk->name) % NLOCKPROF;
+  for(i = 0; i < NLOCKPROF; i++){
+    e = &proftab[c].ent[(h + i) % NLOCKPROF];
+    if(e->name == 0){
+      e->name = lk->name;
+      e->pc = pc;
+    }
+    if(e->name == lk->name && e->pc == pc){
+      e->nacquire++;
+      if(lk->twait){
+        e->ncontend++;
+        e->wait += lk->twait;
+      }
+      e->hold += held;
+      return;
+    }
+  }
+  // Table full: drop the sample.
+}
+
+// Control the lock profiler. LOCKPROF_READ merges the per-CPU
+// tables into up to n entries of lp and returns how many it
+// filled; the other commands return 0. LOCKPROF_RESET leaves
+// the per-lock getlockstat() counters alone: only a lock's
+// holder may write them.
+int
+lockprofctl(int cmd, struct lockprof *lp, int n)
+{
+  struct profent *e;
+  struct lockprof *q;
+  int c, m;
+
+  switch(cmd){
+  case LOCKPROF_ENABLE:
+    profon = 1;
+    return 0;
+  case LOCKPROF_DISABLE:
+    profon = 0;
+    return 0;
+  case LOCKPROF_RESET:
+    xadd(&profgen, 1);
+    return 0;
+  case LOCKPROF_READ:
+    break;
+  default:
+    return -1;
+  }
+
+  // Other CPUs may be recording while we read; the
+  // result is a snapshot, not an atomic one.
+  m = 0;
+  for(c = 0; c < ncpu; c++){
+    if(proftab[c].gen != profgen)
+      continue;
+    for(e = proftab[c].ent; e < &proftab[c].ent[NLOCKPROF]; e++){
+      if(e->name == 0)
+        continue;
+      for(q = lp; q < &lp[m]; q++)
+        if(q->pc == e->pc && strncmp(q->name, e->name, sizeof(q->name)) == 0)
+          break;
+      if(q == &lp[m]){
+        if(m == n)
+          continue;
+        memset(q, 0, sizeof(*q));
+        safestrcpy(q->name, e->name, sizeof(q->name));
+        q->pc = e->pc;
+        m++;
+      }
+      q->nacquire += e->nacquire;
+      q->ncontend += e->ncontend;
+      q->wait += e->wait >> 10;
+      q->hold += e->hold >> 10;
+    }
+  }
+  return m;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
+  uint eflags;
+
   lk->name = name;
+  lk->next = 0;
+  lk->owner = 0;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->nacquire = 0;
+  lk->ncontend = 0;
+  lk->nspin = 0;
+  lk->maxhold = 0;
+  lk->prof = 0;
+
+  eflags = statlock();
+  lk->snext = locklist;
+  if(locklist)
+    locklist->spprev = &lk->snext;
+  lk->spprev = &locklist;
+  locklist = lk;
+  statunlock(eflags);
+}
+
+// Take lk off the list of locks before the memory holding it
+// is freed. Does nothing if initlock() was never called on it.
+void
+freelock(struct spinlock *lk)
+{
+  uint eflags;
+
+  eflags = statlock();
+  if(lk->spprev){
+    *lk->spprev = lk->snext;
+    if(lk->snext)
+      lk->snext->spprev = lk->spprev;
+    lk->spprev = 0;
+  }
+  statunlock(eflags);
 }
 
 // Acquire the lock.
@@ -24,33 +198,65 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket, spins, t0;
+  int prof;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  prof = profon;
+  t0 = prof ? rdtsc() : 0;
+
+  // The xadd is atomic, so every CPU gets a distinct ticket.
+  // Waiters only read owner, and pause between reads so the
+  // spinning CPU doesn't flood the bus.
+  ticket = xadd(&lk->next, 1);
+  for(spins = 0; *(volatile uint*)&lk->owner != ticket; spins++)
+    pause();
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
   // references happen after the lock is acquired.
   __sync_synchronize();
 
+  lk->locked = 1;
+
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+
+  lk->nacquire++;
+  if(spins){
+    lk->ncontend++;
+    lk->nspin += spins;
+  }
+  // tacquire is only touched by the holder, on the lock's own
+  // cache line, so timing every hold costs no sharing.
+  lk->tacquire = rdtsc();
+  lk->prof = prof;
+  if(prof)
+    lk->twait = spins ? lk->tacquire - t0 : 0;
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  uint held;
+
   if(!holding(lk))
     panic("release");
 
+  held = rdtsc() - lk->tacquire;
+  if(held > lk->maxhold)
+    lk->maxhold = held;
+  if(lk->prof)
+    profrecord(lk, held);
+
   lk->pcs[0] = 0;
   lk->cpu = 0;
+  lk->locked = 0;
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that all the stores in the critical
@@ -59,14 +265,41 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Hand the lock to the next ticket. Only the holder writes
+  // owner, so a plain store is enough, but it must be a single
+  // store the compiler can't split or elide.
+  asm volatile("movl %1, %0" : "=m" (lk->owner) : "r" (lk->owner + 1));
 
   popcli();
 }
 
+// Copy the counters of up to n locks that have been acquired
+// to st. Holders update them while we read, so each is only
+// a snapshot. Returns the number copied.
+int
+getlockstats(struct lockstat *st, int n)
+{
+  struct spinlock *lk;
+  uint eflags;
+  int i;
+
+  i = 0;
+  eflags = statlock();
+  for(lk = locklist; lk && i < n; lk = lk->snext){
+    if(lk->nacquire == 0)
+      continue;
+    safestrcpy(st[i].name, lk->name, sizeof(st[i].name));
+    st[i].lock = (uint)lk;
+    st[i].nacquire = lk->nacquire;
+    st[i].ncontend = lk->ncontend;
+    st[i].nspin = lk->nspin;
+    st[i].maxhold = lk->maxhold;
+    i++;
+  }
+  statunlock(eflags);
+  return i;
+}
+
 // Record the current call stack in pcs[] by following the %ebp chain.
 void
 getcallerpcs(void *v, uint pcs[])
@@ -1,5 +1,9 @@
 // Mutual exclusion lock.
+// A ticket lock: acquire() takes the next ticket and spins until
+// owner reaches it, so waiting CPUs are served in FIFO order.
 struct spinlock {
+  uint next;         // Next ticket to hand out
+  uint owner;        // Ticket now holding the lock
   uint locked;       // Is the lock held?
 
   // For debugging:
@@ -7,5 +11,18 @@ struct spinlock {
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
-};
 
+  // For getlockstat(). The counters are only written by the
+  // holder, so they need no atomic instructions.
+  uint nacquire;     // Number of acquire() calls
+  uint ncontend;     // Acquires that had to wait
+  uint nspin;        // Total spin iterations while waiting
+  uint maxhold;      // Longest hold, in TSC cycles
+  uint tacquire;     // TSC when the lock was acquired
+  struct spinlock *snext;   // List of all locks, for getlockstat()
+  struct spinlock **spprev; // Link pointing at this lock, or 0
+
+  // For the lock profiler:
+  int prof;          // Report this hold to the lock profiler?
+  uint twait;        // TSC cycles spent waiting, if prof
+};
@@ -113,6 +113,25 @@ extern int sys_thread_exit(void);
 extern int sys_thread_join(void);
 extern int sys_pwrite(void);
 extern int sys_pread(void);
+extern int sys_sendfile(void);
+extern int sys_fcntl(void);
+extern int sys_vmsplice(void);
+extern int sys_poll(void);
+extern int sys_epoll_create(void);
+extern int sys_epoll_ctl(void);
+extern int sys_epoll_wait(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_preadv(void);
+extern int sys_pwritev(void);
+extern int sys_io_setup(void);
+extern int sys_io_enter(void);
+extern int sys_getlockstat(void);
+extern int sys_lockprof(void);
+extern int sys_futex(void);
+extern int sys_sched_setaffinity(void);
+extern int sys_sched_gang(void);
+extern int sys_cr3reloads(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -146,6 +165,25 @@ static int (*syscalls[])(void) = {
 [SYS_thread_join] sys_thread_join,
 [SYS_pwrite] sys_pwrite,
 [SYS_pread] sys_pread,
+[SYS_sendfile] sys_sendfile,
+[SYS_fcntl] sys_fcntl,
+[SYS_vmsplice] sys_vmsplice,
+[SYS_poll] sys_poll,
+[SYS_epoll_create] sys_epoll_create,
+[SYS_epoll_ctl] sys_epoll_ctl,
+[SYS_epoll_wait] sys_epoll_wait,
+[SYS_readv] sys_readv,
+[SYS_writev] sys_writev,
+[SYS_preadv] sys_preadv,
+[SYS_pwritev] sys_pwritev,
+[SYS_io_setup] sys_io_setup,
+[SYS_io_enter] sys_io_enter,
+[SYS_getlockstat] sys_getlockstat,
+[SYS_lockprof] sys_lockprof,
+[SYS_futex]   sys_futex,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_gang] sys_sched_gang,
+[SYS_cr3reloads] sys_cr3reloads,
 };
 
 void
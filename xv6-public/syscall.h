@@ -30,3 +30,22 @@
 #define SYS_thread_join   29
 #define SYS_pwrite 30
 #define SYS_pread  31
+#define SYS_sendfile 32
+#define SYS_fcntl  33
+#define SYS_vmsplice 34
+#define SYS_poll   35
+#define SYS_epoll_create 36
+#define SYS_epoll_ctl 37
+#define SYS_epoll_wait 38
+#define SYS_readv  39
+#define SYS_writev 40
+#define SYS_preadv 41
+#define SYS_pwritev 42
+#define SYS_io_setup 43
+#define SYS_io_enter 44
+#define SYS_getlockstat 45
+#define SYS_lockprof 46
+#define SYS_futex 47
+#define SYS_sched_setaffinity 48
+#define SYS_sched_gang 49
+#define SYS_cr3reloads 50
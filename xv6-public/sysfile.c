@@ -15,6 +15,9 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "poll.h"
+#include "uio.h"
+#include "ioring.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -118,6 +121,214 @@ sys_pread(void){
   return pread(f, p, n, off);
 }
 
+int
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int n;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesend(out, in, n);
+}
+
+// Wait for events on several fds at once; timeout is in
+// clock ticks, negative to wait forever.
+int
+sys_poll(void)
+{
+  struct pollfd *fds;
+  int nfds, timeout;
+
+  if(argint(1, &nfds) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(nfds < 0 || nfds > NOFILE)
+    return -1;
+  if(argptr(0, (char**)&fds, nfds*sizeof(*fds)) < 0)
+    return -1;
+  return pollfds(fds, nfds, timeout);
+}
+
+int
+sys_epoll_create(void)
+{
+  struct eventpoll *ep;
+  struct file *f;
+  int fd;
+
+  if((ep = epollalloc()) == 0)
+    return -1;
+  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
+    if(f)
+      fileclose(f);
+    epollclose(ep);
+    return -1;
+  }
+  f->type = FD_EPOLL;
+  f->readable = 0;
+  f->writable = 0;
+  f->ep = ep;
+  return fd;
+}
+
+int
+sys_epoll_ctl(void)
+{
+  struct file *epf, *f;
+  struct epoll_event *ev;
+  int op, fd;
+
+  if(argfd(0, 0, &epf) < 0 || argint(1, &op) < 0 || argfd(2, &fd, &f) < 0)
+    return -1;
+  if(epf->type != FD_EPOLL)
+    return -1;
+  ev = 0;
+  if(op != EPOLL_CTL_DEL && argptr(3, (char**)&ev, sizeof(*ev)) < 0)
+    return -1;
+  return epollctl(epf->ep, op, fd, f, ev);
+}
+
+int
+sys_epoll_wait(void)
+{
+  struct file *epf;
+  struct epoll_event *evs;
+  int maxevents, timeout;
+
+  if(argfd(0, 0, &epf) < 0 || argint(2, &maxevents) < 0 ||
+     argint(3, &timeout) < 0)
+    return -1;
+  if(epf->type != FD_EPOLL || maxevents <= 0)
+    return -1;
+  if(argptr(1, (char**)&evs, maxevents*sizeof(*evs)) < 0)
+    return -1;
+  return epollwait(epf->ep, evs, maxevents, timeout);
+}
+
+// Write n bytes at p into a pipe, handing over whole
+// page-aligned pages instead of copying them. Those pages
+// read as zeros afterwards.
+int
+sys_vmsplice(void)
+{
+  struct file *f;
+  int n;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+    return -1;
+  if(f->type != FD_PIPE || f->writable == 0)
+    return -1;
+  return pipegift(f->pipe, p, n, f->flags & O_NONBLOCK);
+}
+
+int
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  switch(cmd){
+  case F_GETPIPE_SZ:
+    if(f->type != FD_PIPE)
+      return -1;
+    return pipegetsize(f->pipe);
+  case F_SETPIPE_SZ:
+    if(f->type != FD_PIPE)
+      return -1;
+    return pipesetsize(f->pipe, arg);
+  case F_GETFL:
+    return f->flags | (f->readable && f->writable ? O_RDWR :
+                       f->writable ? O_WRONLY : O_RDONLY);
+  case F_SETFL:
+    f->flags = arg & O_NONBLOCK;
+    return 0;
+  }
+  return -1;
+}
+
+// Is [p, p+n) in the current process's memory?
+static int
+uservalid(char *p, int n)
+{
+  struct proc *curproc = myproc();
+
+  return n >= 0 && (uint)p < curproc->sz && (uint)p + n <= curproc->sz;
+}
+
+// Fetch the iovec array at argument n and its length at
+// argument n+1 into iov, checking that every segment lies
+// in user memory. The array is copied so that it can't
+// change after being checked.
+static int
+argiov(int n, struct iovec *iov, int *piovcnt)
+{
+  struct iovec *uiov;
+  int i, iovcnt;
+
+  if(argint(n+1, &iovcnt) < 0 || iovcnt < 0 || iovcnt > UIO_MAXIOV)
+    return -1;
+  if(argptr(n, (char**)&uiov, iovcnt*sizeof(*uiov)) < 0)
+    return -1;
+  for(i = 0; i < iovcnt; i++){
+    iov[i] = uiov[i];
+    if(!uservalid(iov[i].iov_base, iov[i].iov_len))
+      return -1;
+  }
+  *piovcnt = iovcnt;
+  return 0;
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[UIO_MAXIOV];
+  int iovcnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &iovcnt) < 0)
+    return -1;
+  return filereadv(f, iov, iovcnt);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[UIO_MAXIOV];
+  int iovcnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &iovcnt) < 0)
+    return -1;
+  return filewritev(f, iov, iovcnt);
+}
+
+int
+sys_preadv(void)
+{
+  struct file *f;
+  struct iovec iov[UIO_MAXIOV];
+  int iovcnt, off;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &iovcnt) < 0 || argint(3, &off) < 0)
+    return -1;
+  return preadv(f, iov, iovcnt, off);
+}
+
+int
+sys_pwritev(void)
+{
+  struct file *f;
+  struct iovec iov[UIO_MAXIOV];
+  int iovcnt, off;
+
+  if(argfd(0, 0, &f) < 0 || argiov(1, iov, &iovcnt) < 0 || argint(3, &off) < 0)
+    return -1;
+  return pwritev(f, iov, iovcnt, off);
+}
+
 int
 sys_close(void)
 {
@@ -200,6 +411,11 @@ isdirempty(struct inode *dp)
   struct dirent de;
 
   for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+    // Most of a hashed directory is unallocated buckets.
+    if(off%BSIZE == 0 && !iallocated(dp, off, BSIZE)){
+      off += BSIZE - sizeof(de);
+      continue;
+    }
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
     if(de.inum != 0)
@@ -243,9 +459,13 @@ sys_unlink(void)
     goto bad;
   }
 
+  // Keep the name: in a hashed directory an unlinked slot
+  // must not look never-used, or lookups would stop there.
   memset(&de, 0, sizeof(de));
+  strncpy(de.name, name, DIRSIZ);
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcinvalidate(dp, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -303,27 +523,33 @@ create(char *path, short type, short major, short minor)
       panic("create dots");
   }
 
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  if(dirlink(dp, name, ip->inum) < 0){
+    // dp has no free slot left on name's probe sequence.
+    if(type == T_DIR){
+      dp->nlink--;
+      iupdate(dp);
+    }
+    ip->nlink = 0;
+    iupdate(ip);
+    iunlockput(ip);
+    iunlockput(dp);
+    return 0;
+  }
 
   iunlockput(dp);
 
   return ip;
 }
 
-int
-sys_open(void)
+// Open path with mode omode and return a new fd.
+static int
+fileopen(char *path, int omode)
 {
-  char *path;
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
-    return -1;
-
   begin_op();
-
   if(omode & O_CREATE){
     ip = create(path, T_FILE, 0, 0);
     if(ip == 0){
@@ -336,7 +562,7 @@ sys_open(void)
       return -1;
     }
     ilock(ip);
-    if(ip->type == T_DIR && omode != O_RDONLY){
+    if(ip->type == T_DIR && (omode & (O_WRONLY|O_RDWR))){
       iunlockput(ip);
       end_op();
       return -1;
@@ -358,9 +584,21 @@ sys_open(void)
   f->off = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->flags = omode & O_NONBLOCK;
   return fd;
 }
 
+int
+sys_open(void)
+{
+  char *path;
+  int omode;
+
+  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return fileopen(path, omode);
+}
+
 int
 sys_mkdir(void)
 {
@@ -471,3 +709,102 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+// Register ring as the process's submission ring for
+// io_enter(); a null ring unregisters it.
+int
+sys_io_setup(void)
+{
+  struct io_ring *ring;
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  if(addr == 0){
+    myproc()->ioring = 0;
+    return 0;
+  }
+  if(argptr(0, (char**)&ring, sizeof(*ring)) < 0 || addr % 4 != 0)
+    return -1;
+  myproc()->ioring = ring;
+  return 0;
+}
+
+// Run one submission entry, as the corresponding system
+// call would, and return its result.
+static int
+ioringop(struct io_sqe *sqe)
+{
+  struct proc *curproc = myproc();
+  struct file *f;
+  char *path;
+
+  if(sqe->opcode == IORING_OP_OPEN){
+    if(fetchstr((uint)sqe->addr, &path) < 0)
+      return -1;
+    return fileopen(path, sqe->len);
+  }
+  if(sqe->fd < 0 || sqe->fd >= NOFILE || (f = curproc->ofile[sqe->fd]) == 0)
+    return -1;
+  switch(sqe->opcode){
+  case IORING_OP_READ:
+  case IORING_OP_WRITE:
+  case IORING_OP_PREAD:
+  case IORING_OP_PWRITE:
+    if(!uservalid(sqe->addr, sqe->len))
+      return -1;
+    break;
+  }
+  switch(sqe->opcode){
+  case IORING_OP_READ:
+    return fileread(f, sqe->addr, sqe->len);
+  case IORING_OP_WRITE:
+    return filewrite(f, sqe->addr, sqe->len);
+  case IORING_OP_PREAD:
+    return pread(f, sqe->addr, sqe->len, sqe->off);
+  case IORING_OP_PWRITE:
+    return pwrite(f, sqe->addr, sqe->len, sqe->off);
+  case IORING_OP_CLOSE:
+    curproc->ofile[sqe->fd] = 0;
+    fileclose(f);
+    return 0;
+  }
+  return -1;
+}
+
+// Run up to n queued submissions from the registered ring,
+// in order, posting a completion for each. Stops early when
+// the submission queue is empty or the completion queue is
+// full. Entries run synchronously, so one that sleeps (a read
+// from an empty pipe, say) holds up the rest.
+// Returns the number of entries run.
+int
+sys_io_enter(void)
+{
+  struct io_ring *ring;
+  struct io_sqe sqe;
+  struct io_cqe *cqe;
+  int n, i;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  ring = myproc()->ioring;
+  if(ring == 0 || !uservalid((char*)ring, sizeof(*ring)))
+    return -1;
+  for(i = 0; i < n; i++){
+    if(ring->sq_head == ring->sq_tail)
+      break;
+    if(ring->cq_tail - ring->cq_head >= IORING_ENTRIES)
+      break;
+    if(myproc()->killed)
+      return -1;
+    // Copy the entry so the program can't change it under us.
+    sqe = ring->sq[ring->sq_head % IORING_ENTRIES];
+    ring->sq_head++;
+    cqe = &ring->cq[ring->cq_tail % IORING_ENTRIES];
+    cqe->user_data = sqe.user_data;
+    cqe->res = ioringop(&sqe);
+    ring->cq_tail++;
+  }
+  return i;
+}
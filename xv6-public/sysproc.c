@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "lockstat.h"
+#include "futex.h"
 
 int
 sys_fork(void)
@@ -167,3 +169,74 @@ sys_thread_join(void){
 
   return 0;
 }
+
+// Copy up to n spin lock counters to user space.
+int
+sys_getlockstat(void)
+{
+  struct lockstat *st;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0 || n > NLOCKSTAT)
+    return -1;
+  if(argptr(0, (char**)&st, n*sizeof(*st)) < 0)
+    return -1;
+  return getlockstats(st, n);
+}
+
+// Control the lock profiler; see lockprofctl().
+int
+sys_lockprof(void)
+{
+  struct lockprof *lp;
+  int cmd, n;
+
+  if(argint(0, &cmd) < 0 || argint(2, &n) < 0 || n < 0 || n > NCPU*NLOCKPROF)
+    return -1;
+  if(argptr(1, (char**)&lp, n*sizeof(*lp)) < 0)
+    return -1;
+  return lockprofctl(cmd, lp, n);
+}
+
+int
+sys_futex(void)
+{
+  int addr, op, val;
+
+  if(argint(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  switch(op){
+  case FUTEX_WAIT:
+    return futexwait(addr, val);
+  case FUTEX_WAKE:
+    return futexwake(addr, val);
+  }
+  return -1;
+}
+
+int
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, (uint)mask);
+}
+
+int
+sys_sched_gang(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return setgang(on);
+}
+
+// Number of times any CPU has loaded a user page table.
+int
+sys_cr3reloads(void)
+{
+  return uvmreloads();
+}
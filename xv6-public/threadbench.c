@@ -0,0 +1,172 @@
+// Compare the uthread primitives with a hand-rolled spin lock.
+//
+// threadbench [nthread]
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "uthread.h"
+
+#define MAXTHREAD 8
+#define NITER     20000
+#define NROUND    1000
+#define NTASK     2000
+
+int nthread = 4;
+int counter;
+
+uint spinword;
+struct umutex mutex;
+struct urwlock rwlock;
+struct ubarrier barrier;
+
+void
+fail(char *msg)
+{
+  printf(1, "threadbench: %s\n", msg);
+  exit();
+}
+
+void*
+spinmain(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NITER; i++){
+    while(xchg(&spinword, 1) != 0)
+      ;
+    counter++;
+    xchg(&spinword, 0);
+  }
+  thread_exit(0);
+}
+
+void*
+mutexmain(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NITER; i++){
+    umutex_lock(&mutex);
+    counter++;
+    umutex_unlock(&mutex);
+  }
+  thread_exit(0);
+}
+
+// One write in sixteen.
+void*
+rwlockmain(void *arg)
+{
+  int i, v;
+
+  for(i = 0; i < NITER; i++){
+    if(i % 16 == 0){
+      urwlock_wrlock(&rwlock);
+      counter++;
+      urwlock_wrunlock(&rwlock);
+    } else {
+      urwlock_rdlock(&rwlock);
+      v = counter;
+      urwlock_rdunlock(&rwlock);
+      if(v < 0)
+        fail("counter went negative");
+    }
+  }
+  thread_exit(0);
+}
+
+void*
+barriermain(void *arg)
+{
+  int i;
+
+  for(i = 0; i < NROUND; i++){
+    // Exactly one thread per round sees 1.
+    if(ubarrier_wait(&barrier)){
+      umutex_lock(&mutex);
+      counter++;
+      umutex_unlock(&mutex);
+    }
+  }
+  thread_exit(0);
+}
+
+void
+task(void *arg)
+{
+  umutex_lock(&mutex);
+  counter += (int)arg;
+  umutex_unlock(&mutex);
+}
+
+// Run fn in nthread threads; return the ticks taken.
+int
+run(void *(*fn)(void*))
+{
+  thread_t tid[MAXTHREAD];
+  void *ret;
+  int i, start;
+
+  counter = 0;
+  start = uptime();
+  for(i = 0; i < nthread; i++)
+    if(thread_create(&tid[i], fn, 0) != 0)
+      fail("thread_create failed");
+  for(i = 0; i < nthread; i++)
+    if(thread_join(tid[i], &ret) != 0)
+      fail("thread_join failed");
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct upool pool;
+  int t, i;
+
+  if(argc > 1)
+    nthread = atoi(argv[1]);
+  if(nthread < 1 || nthread > MAXTHREAD)
+    fail("bad thread count");
+  printf(1, "threadbench: %d threads\n", nthread);
+
+  t = run(spinmain);
+  if(counter != nthread * NITER)
+    fail("spin lock lost updates");
+  printf(1, "spin lock:  %d ticks\n", t);
+
+  umutex_init(&mutex);
+  t = run(mutexmain);
+  if(counter != nthread * NITER)
+    fail("mutex lost updates");
+  printf(1, "mutex:      %d ticks\n", t);
+
+  urwlock_init(&rwlock);
+  t = run(rwlockmain);
+  if(counter != nthread * (NITER / 16))
+    fail("rwlock lost updates");
+  printf(1, "rwlock:     %d ticks\n", t);
+
+  ubarrier_init(&barrier, nthread);
+  t = run(barriermain);
+  if(counter != NROUND)
+    fail("barrier released the wrong number of rounds");
+  printf(1, "barrier:    %d ticks\n", t);
+
+  counter = 0;
+  t = uptime();
+  if(upool_init(&pool, nthread) < 0)
+    fail("upool_init failed");
+  for(i = 0; i < NTASK; i++)
+    upool_submit(&pool, task, (void*)1);
+  upool_wait(&pool);
+  upool_destroy(&pool);
+  t = uptime() - t;
+  if(counter != NTASK)
+    fail("thread pool lost tasks");
+  printf(1, "pool:       %d ticks\n", t);
+
+  printf(1, "threadbench ok\n");
+  exit();
+}
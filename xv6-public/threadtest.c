@@ -277,6 +277,7 @@ stresstest(void)
   thread_t threads[NUM_THREAD];
   int i, n;
   void *retval;
+  char *top = 0;
 
   for (n = 1; n <= nstress; n++){
     if (n % 1000 == 0)
@@ -293,6 +294,14 @@ stresstest(void)
         return -1;
       }
     }
+    // Joined threads' stacks are reused, so the address
+    // space should stop growing after the first round.
+    if (n == 1)
+      top = sbrk(0);
+    else if (sbrk(0) != top){
+      printf(1, "panic: address space grew\n");
+      return -1;
+    }
   }
   printf(1, "\n");
   return 0;
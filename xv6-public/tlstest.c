@@ -0,0 +1,84 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NUM_THREAD 5
+#define NUM_INCR   100000
+
+// Layout of our TLS block. The first word is the block's
+// own address, set up by the kernel.
+struct tls {
+  void *self;
+  int id;
+  int count;
+};
+
+void*
+tlsthreadmain(void *arg)
+{
+  struct tls *t = gettls();
+  int i;
+
+  if(t->self != t || t->id != 0 || t->count != 0)
+    thread_exit((void*)-1);
+  t->id = (int)arg;
+  for(i = 0; i < NUM_INCR; i++)
+    ((struct tls*)gettls())->count++;
+  if(t->id != (int)arg || t->count != NUM_INCR)
+    thread_exit((void*)-1);
+  thread_exit(t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  thread_t threads[NUM_THREAD];
+  void *ret[NUM_THREAD];
+  struct tls *t;
+  int i, j;
+
+  printf(1, "tlstest starting\n");
+  t = gettls();
+  if(t == 0 || t->self != t){
+    printf(1, "main thread has no TLS block\n");
+    exit();
+  }
+  t->id = -1;
+
+  for(i = 0; i < NUM_THREAD; i++)
+    if(thread_create(&threads[i], tlsthreadmain, (void*)i) != 0){
+      printf(1, "thread_create failed\n");
+      exit();
+    }
+  for(i = 0; i < NUM_THREAD; i++){
+    if(thread_join(threads[i], &ret[i]) != 0 || ret[i] == (void*)-1){
+      printf(1, "thread %d saw wrong TLS contents\n", i);
+      exit();
+    }
+    if(ret[i] == t){
+      printf(1, "thread %d shared the main thread's TLS\n", i);
+      exit();
+    }
+    for(j = 0; j < i; j++)
+      if(ret[j] == ret[i]){
+        printf(1, "threads %d and %d shared TLS\n", j, i);
+        exit();
+      }
+  }
+  if(t->id != -1){
+    printf(1, "main thread's TLS was overwritten\n");
+    exit();
+  }
+
+  // A forked child keeps its parent's TLS layout.
+  if(fork() == 0){
+    t = gettls();
+    if(t->self != t || t->id != -1)
+      printf(1, "child lost its TLS\n");
+    exit();
+  }
+  wait();
+
+  printf(1, "tlstest ok\n");
+  exit();
+}
@@ -0,0 +1,7 @@
+// Scatter/gather I/O: readv, writev, preadv, pwritev.
+#define UIO_MAXIOV 16  // most segments in one call
+
+struct iovec {
+  void *iov_base;  // start of segment
+  int iov_len;     // length of segment in bytes
+};
@@ -103,3 +103,15 @@ memmove(void *vdst, void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Address of this thread's TLS block. The kernel gives each
+// thread TLSSIZE zeroed bytes whose first word holds the block's
+// own address, and points %gs at the block.
+void*
+gettls(void)
+{
+  void *p;
+
+  asm volatile("movl %%gs:0, %0" : "=r" (p));
+  return p;
+}
@@ -1,5 +1,11 @@
 struct stat;
 struct rtcdate;
+struct pollfd;
+struct epoll_event;
+struct iovec;
+struct io_ring;
+struct lockstat;
+struct lockprof;
 
 // system calls
 int fork(void);
@@ -33,6 +39,25 @@ void thread_exit(void*) __attribute__((noreturn));
 int thread_join(thread_t, void**);
 int pwrite(int, void*, int, int);
 int pread(int, void*, int, int);
+int sendfile(int, int, int);
+int fcntl(int, int, int);
+int vmsplice(int, void*, int);
+int poll(struct pollfd*, int, int);
+int epoll_create(void);
+int epoll_ctl(int, int, int, struct epoll_event*);
+int epoll_wait(int, struct epoll_event*, int, int);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int preadv(int, struct iovec*, int, int);
+int pwritev(int, struct iovec*, int, int);
+int io_setup(struct io_ring*);
+int io_enter(int);
+int getlockstat(struct lockstat*, int);
+int lockprof(int, struct lockprof*, int);
+int futex(int*, int, int);
+int sched_setaffinity(int, uint);
+int sched_gang(int);
+int cr3reloads(void);
 
 // ulib.c
 int stat(char*, struct stat*);
@@ -46,4 +71,5 @@ uint strlen(char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
+void* gettls(void);
 int atoi(const char*);
@@ -0,0 +1,267 @@
+// User-level mutexes, condition variables, barriers,
+// reader/writer locks and thread pools, built on futex().
+
+#include "types.h"
+#include "user.h"
+#include "x86.h"
+#include "futex.h"
+#include "uthread.h"
+
+#define WAKEALL 0x7fffffff
+
+// Mutexes follow Drepper's "Futexes Are Tricky": an uncontended
+// lock and unlock are one atomic instruction each, and only an
+// unlock that may have sleepers makes a system call.
+
+void
+umutex_init(struct umutex *m)
+{
+  m->val = 0;
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+  uint c;
+
+  if((c = cmpxchg(&m->val, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = xchg(&m->val, 2);
+  while(c != 0){
+    futex((int*)&m->val, FUTEX_WAIT, 2);
+    c = xchg(&m->val, 2);
+  }
+}
+
+// Returns 1 if the lock was taken, 0 if it is held.
+int
+umutex_trylock(struct umutex *m)
+{
+  return cmpxchg(&m->val, 0, 1) == 0;
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+  if(xchg(&m->val, 0) == 2)
+    futex((int*)&m->val, FUTEX_WAKE, 1);
+}
+
+void
+ucond_init(struct ucond *c)
+{
+  c->seq = 0;
+}
+
+// Atomically release m and wait for a signal, then retake m.
+// Like any condition variable wait it may return spuriously,
+// so callers recheck their condition in a loop.
+void
+ucond_wait(struct ucond *c, struct umutex *m)
+{
+  uint seq;
+
+  seq = c->seq;
+  umutex_unlock(m);
+  // If a signal bumped seq after we read it, this returns at once.
+  futex((int*)&c->seq, FUTEX_WAIT, seq);
+  umutex_lock(m);
+}
+
+void
+ucond_signal(struct ucond *c)
+{
+  xadd(&c->seq, 1);
+  futex((int*)&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+ucond_broadcast(struct ucond *c)
+{
+  xadd(&c->seq, 1);
+  futex((int*)&c->seq, FUTEX_WAKE, WAKEALL);
+}
+
+void
+ubarrier_init(struct ubarrier *b, int n)
+{
+  umutex_init(&b->m);
+  ucond_init(&b->c);
+  b->n = n;
+  b->count = 0;
+  b->gen = 0;
+}
+
+// Wait until n threads have called ubarrier_wait().
+// Returns 1 in exactly one of them, 0 in the others.
+int
+ubarrier_wait(struct ubarrier *b)
+{
+  uint gen;
+
+  umutex_lock(&b->m);
+  gen = b->gen;
+  if(++b->count == b->n){
+    b->count = 0;
+    b->gen++;
+    ucond_broadcast(&b->c);
+    umutex_unlock(&b->m);
+    return 1;
+  }
+  while(gen == b->gen)
+    ucond_wait(&b->c, &b->m);
+  umutex_unlock(&b->m);
+  return 0;
+}
+
+void
+urwlock_init(struct urwlock *rw)
+{
+  umutex_init(&rw->m);
+  ucond_init(&rw->readok);
+  ucond_init(&rw->writeok);
+  rw->readers = 0;
+  rw->writer = 0;
+  rw->wwait = 0;
+}
+
+void
+urwlock_rdlock(struct urwlock *rw)
+{
+  umutex_lock(&rw->m);
+  while(rw->writer || rw->wwait)
+    ucond_wait(&rw->readok, &rw->m);
+  rw->readers++;
+  umutex_unlock(&rw->m);
+}
+
+void
+urwlock_rdunlock(struct urwlock *rw)
+{
+  umutex_lock(&rw->m);
+  if(--rw->readers == 0 && rw->wwait)
+    ucond_signal(&rw->writeok);
+  umutex_unlock(&rw->m);
+}
+
+void
+urwlock_wrlock(struct urwlock *rw)
+{
+  umutex_lock(&rw->m);
+  rw->wwait++;
+  while(rw->writer || rw->readers)
+    ucond_wait(&rw->writeok, &rw->m);
+  rw->wwait--;
+  rw->writer = 1;
+  umutex_unlock(&rw->m);
+}
+
+void
+urwlock_wrunlock(struct urwlock *rw)
+{
+  umutex_lock(&rw->m);
+  rw->writer = 0;
+  if(rw->wwait)
+    ucond_signal(&rw->writeok);
+  else
+    ucond_broadcast(&rw->readok);
+  umutex_unlock(&rw->m);
+}
+
+static void*
+upool_worker(void *arg)
+{
+  struct upool *p = arg;
+  void (*fn)(void*);
+  void *a;
+
+  umutex_lock(&p->m);
+  for(;;){
+    while(p->head == p->tail && !p->stop)
+      ucond_wait(&p->nonempty, &p->m);
+    if(p->head == p->tail)
+      break;  // stopping, and the queue is drained
+    fn = p->fn[p->head % UPOOL_QSIZE];
+    a = p->arg[p->head % UPOOL_QSIZE];
+    p->head++;
+    ucond_signal(&p->nonfull);
+    umutex_unlock(&p->m);
+
+    fn(a);
+
+    umutex_lock(&p->m);
+    if(--p->pending == 0)
+      ucond_broadcast(&p->idle);
+  }
+  umutex_unlock(&p->m);
+  thread_exit(0);
+}
+
+// Start a pool of nthread workers.
+// Returns 0, or -1 if the threads couldn't be created.
+int
+upool_init(struct upool *p, int nthread)
+{
+  int i;
+
+  if(nthread < 1 || nthread > UPOOL_MAXTHREAD)
+    return -1;
+  umutex_init(&p->m);
+  ucond_init(&p->nonempty);
+  ucond_init(&p->nonfull);
+  ucond_init(&p->idle);
+  p->head = p->tail = 0;
+  p->pending = 0;
+  p->stop = 0;
+  p->nthread = 0;
+  for(i = 0; i < nthread; i++){
+    if(thread_create(&p->tid[i], upool_worker, p) != 0){
+      upool_destroy(p);
+      return -1;
+    }
+    p->nthread++;
+  }
+  return 0;
+}
+
+// Queue fn(arg) to run on a worker, waiting if the queue is full.
+void
+upool_submit(struct upool *p, void (*fn)(void*), void *arg)
+{
+  umutex_lock(&p->m);
+  while(p->tail - p->head == UPOOL_QSIZE)
+    ucond_wait(&p->nonfull, &p->m);
+  p->fn[p->tail % UPOOL_QSIZE] = fn;
+  p->arg[p->tail % UPOOL_QSIZE] = arg;
+  p->tail++;
+  p->pending++;
+  ucond_signal(&p->nonempty);
+  umutex_unlock(&p->m);
+}
+
+// Wait until every submitted task has finished.
+void
+upool_wait(struct upool *p)
+{
+  umutex_lock(&p->m);
+  while(p->pending)
+    ucond_wait(&p->idle, &p->m);
+  umutex_unlock(&p->m);
+}
+
+// Run the remaining tasks, then stop and join the workers.
+void
+upool_destroy(struct upool *p)
+{
+  void *ret;
+  int i;
+
+  umutex_lock(&p->m);
+  p->stop = 1;
+  ucond_broadcast(&p->nonempty);
+  umutex_unlock(&p->m);
+  for(i = 0; i < p->nthread; i++)
+    thread_join(p->tid[i], &ret);
+  p->nthread = 0;
+}
@@ -0,0 +1,78 @@
+// User-level synchronization for threads made by thread_create().
+// Everything blocks with futex() rather than spinning.
+// Initialize each object with its _init function before use.
+
+// Mutex. val is 0 when unlocked, 1 when locked, and 2 when
+// locked with threads possibly sleeping on it.
+struct umutex {
+  uint val;
+};
+
+// Condition variable: waiters sleep on a sequence number that
+// signal and broadcast bump.
+struct ucond {
+  uint seq;
+};
+
+// Barrier for n threads.
+struct ubarrier {
+  struct umutex m;
+  struct ucond c;
+  int n;              // threads to wait for
+  int count;          // threads arrived in this round
+  uint gen;           // round number
+};
+
+// Reader/writer lock. Waiting writers keep new readers out,
+// so writers aren't starved.
+struct urwlock {
+  struct umutex m;
+  struct ucond readok;
+  struct ucond writeok;
+  int readers;        // readers holding the lock
+  int writer;         // is a writer holding it?
+  int wwait;          // writers waiting
+};
+
+#define UPOOL_MAXTHREAD 8
+#define UPOOL_QSIZE     64
+
+// Fixed-size pool of worker threads serving a queue of tasks.
+struct upool {
+  struct umutex m;
+  struct ucond nonempty;  // queue gained a task, or stopping
+  struct ucond nonfull;   // queue lost a task
+  struct ucond idle;      // every task has finished
+  void (*fn[UPOOL_QSIZE])(void*);
+  void *arg[UPOOL_QSIZE];
+  uint head;          // next task to run
+  uint tail;          // next free slot
+  int pending;        // tasks queued or running
+  int stop;
+  int nthread;
+  thread_t tid[UPOOL_MAXTHREAD];
+};
+
+void umutex_init(struct umutex*);
+void umutex_lock(struct umutex*);
+int  umutex_trylock(struct umutex*);
+void umutex_unlock(struct umutex*);
+
+void ucond_init(struct ucond*);
+void ucond_wait(struct ucond*, struct umutex*);
+void ucond_signal(struct ucond*);
+void ucond_broadcast(struct ucond*);
+
+void ubarrier_init(struct ubarrier*, int);
+int  ubarrier_wait(struct ubarrier*);
+
+void urwlock_init(struct urwlock*);
+void urwlock_rdlock(struct urwlock*);
+void urwlock_rdunlock(struct urwlock*);
+void urwlock_wrlock(struct urwlock*);
+void urwlock_wrunlock(struct urwlock*);
+
+int  upool_init(struct upool*, int);
+void upool_submit(struct upool*, void (*)(void*), void*);
+void upool_wait(struct upool*);
+void upool_destroy(struct upool*);
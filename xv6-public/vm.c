@@ -152,10 +152,31 @@ switchkvm(void)
   lcr3(V2P(kpgdir));   // switch to the kernel page table
 }
 
-// Switch TSS and h/w page table to correspond to process p.
+// The process owning p's address space: threads share their
+// main thread's page table.
+static struct proc*
+vmowner(struct proc *p)
+{
+  return p->tid ? p->parent : p;
+}
+
+// Note that a user mapping of p's address space was removed or
+// changed, so that switchuvmsched() knows a CPU with the page
+// table still loaded may have stale TLB entries. Call after
+// the PTEs have been changed.
 void
-switchuvm(struct proc *p)
+uvmchanged(struct proc *p)
+{
+  xadd(&vmowner(p)->vmgen, 1);
+}
+
+// Point the TSS and the TLS segment at process p.
+// Caller must have interrupts off.
+static void
+switchts(struct proc *p)
 {
+  struct cpu *c = mycpu();
+
   if(p == 0)
     panic("switchuvm: no process");
   if(p->kstack == 0)
@@ -163,20 +184,80 @@ switchuvm(struct proc *p)
   if(p->pgdir == 0)
     panic("switchuvm: no pgdir");
 
+  // The CPU reads esp0 from the TSS on every trap from user
+  // space, so once the task register is loaded only esp0 needs
+  // to change.
+  if(!c->tssloaded){
+    c->gdt[SEG_TSS] = SEG16(STS_T32A, &c->ts, sizeof(c->ts)-1, 0);
+    c->gdt[SEG_TSS].s = 0;
+    c->ts.ss0 = SEG_KDATA << 3;
+    // setting IOPL=0 in eflags *and* iomb beyond the tss segment limit
+    // forbids I/O instructions (e.g., inb and outb) from user space
+    c->ts.iomb = (ushort) 0xFFFF;
+    ltr(SEG_TSS << 3);
+    c->tssloaded = 1;
+  }
+  c->ts.esp0 = (uint)p->kstack + KSTACKSIZE;
+  // User %gs selects this; trapret reloads %gs from the trap
+  // frame, which picks up the new base.
+  c->gdt[SEG_UTLS] = SEG16(STA_W, p->tlsbase, TLSSIZE-1, DPL_USER);
+}
+
+// Switch TSS and h/w page table to correspond to process p.
+void
+switchuvm(struct proc *p)
+{
+  uint gen;
+
   pushcli();
-  mycpu()->gdt[SEG_TSS] = SEG16(STS_T32A, &mycpu()->ts,
-                                sizeof(mycpu()->ts)-1, 0);
-  mycpu()->gdt[SEG_TSS].s = 0;
-  mycpu()->ts.ss0 = SEG_KDATA << 3;
-  mycpu()->ts.esp0 = (uint)p->kstack + KSTACKSIZE;
-  // setting IOPL=0 in eflags *and* iomb beyond the tss segment limit
-  // forbids I/O instructions (e.g., inb and outb) from user space
-  mycpu()->ts.iomb = (ushort) 0xFFFF;
-  ltr(SEG_TSS << 3);
+  switchts(p);
+  gen = vmowner(p)->vmgen;  // before the flush, or a change made during it is missed
   lcr3(V2P(p->pgdir));  // switch to process's address space
+  mycpu()->pgdir = p->pgdir;
+  mycpu()->vmgen = gen;
+  mycpu()->nreload++;
   popcli();
 }
 
+// switchuvm() for the scheduler: if p's page table is already
+// loaded, as when switching between threads of one process, and
+// no mapping has changed since, keep it and the TLB. The
+// scheduler leaves the last page table loaded between runs, so
+// this also covers switching back to a process after idling.
+// Callers that have just changed p's page table must use
+// switchuvm().
+void
+switchuvmsched(struct proc *p)
+{
+  struct cpu *c;
+  uint gen;
+
+  pushcli();
+  c = mycpu();
+  switchts(p);
+  gen = vmowner(p)->vmgen;
+  if(c->pgdir != p->pgdir || c->vmgen != gen){
+    lcr3(V2P(p->pgdir));
+    c->pgdir = p->pgdir;
+    c->vmgen = gen;
+    c->nreload++;
+  }
+  popcli();
+}
+
+// Number of user page table loads on all CPUs, for cswbench.
+int
+uvmreloads(void)
+{
+  struct cpu *c;
+  int n;
+
+  n = 0;
+  for(c = cpus; c < cpus+ncpu; c++)
+    n += c->nreload;
+  return n;
+}
+
 // Load the initcode into address 0 of pgdir.
 // sz must be less than a page.
 void
@@ -251,7 +332,9 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Returns the new process size.  If the page
+// table may be in use, the caller reports the change with
+// uvmchanged().
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
@@ -298,7 +381,8 @@ freevm(pde_t *pgdir)
 }
 
 // Clear PTE_U on a page. Used to create an inaccessible
-// page beneath the user stack.
+// page beneath the user stack. If the page table may be in
+// use, the caller reports the change with uvmchanged().
 void
 clearpteu(pde_t *pgdir, char *uva)
 {
@@ -357,6 +441,19 @@ uva2ka(pde_t *pgdir, char *uva)
   return (char*)P2V(PTE_ADDR(*pte));
 }
 
+// Set up a zeroed thread-local storage block at user address va.
+// Its first word points at the block itself, so user code can
+// find the block's address by loading %gs:0.
+int
+inittls(pde_t *pgdir, uint va)
+{
+  uint tls[TLSSIZE/4];
+
+  memset(tls, 0, sizeof(tls));
+  tls[0] = va;
+  return copyout(pgdir, va, tls, sizeof(tls));
+}
+
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
 // uva2ka ensures this only works for PTE_U pages.
@@ -383,6 +480,29 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
+// Exchange the physical page mapped at page-aligned user
+// address uva with the kernel page *kpage, so that the caller
+// ends up owning the old user page. pgdir must be the current
+// page table and must not be in use on any other CPU, since
+// only this CPU's TLB is flushed. The caller reports the change
+// with uvmchanged().
+// Returns -1 if uva is not a writable user page.
+int
+swapupage(pde_t *pgdir, char *uva, char **kpage)
+{
+  pte_t *pte;
+  char *old;
+
+  pte = walkpgdir(pgdir, uva, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_U|PTE_W)) != (PTE_P|PTE_U|PTE_W))
+    return -1;
+  old = P2V(PTE_ADDR(*pte));
+  *pte = V2P(*kpage) | PTE_FLAGS(*pte);
+  *kpage = old;
+  lcr3(V2P(pgdir));
+  return 0;
+}
+
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!